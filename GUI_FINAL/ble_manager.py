@@ -18,6 +18,9 @@ class BLEManager:
         self.expected_sequences = 72
         self.last_packet_time = None
         self.data_complete_event = asyncio.Event()
+        self.record_list = {}
+        self.list_complete_event = asyncio.Event()
+        self.session_list = {}
         
         t = threading.Thread(target=self._start_loop, daemon=True)
         t.start()
@@ -55,7 +58,9 @@ class BLEManager:
     async def send_config(self, num_sequences):
         if not self.connected: return False
         try:
-            payload = bytes([0x01]) + int(num_sequences).to_bytes(4, "little")
+            # hora de inicio (unix) para identificar la sesion en el directorio del dispositivo
+            payload = (bytes([0x01]) + int(num_sequences).to_bytes(4, "little")
+                       + int(time.time()).to_bytes(4, "little"))
             char = self.client.services.get_characteristic(RX_CHAR_UUID)
             resp = "write" in char.properties
             await self.client.write_gatt_char(RX_CHAR_UUID, payload, response=resp)
@@ -84,9 +89,89 @@ class BLEManager:
             await asyncio.sleep(0.2)
             
         valid = sum(1 for d in self.session_buffer.values() 
-                    if len(d["ppg1"])>=4096 and len(d["ppg2"])>=4096)
+                    if d["ppg_min"] and len(d["ppg1"])>=d["ppg_min"] and len(d["ppg2"])>=d["ppg_min"])
         return valid > 0
 
+    async def request_list(self):
+        self.record_list = {}
+        self.list_complete_event.clear()
+        if not self.connected: return None
+        try:
+            await self.client.write_gatt_char(RX_CHAR_UUID, bytes([0x03]), response=True)
+            await asyncio.wait_for(self.list_complete_event.wait(), timeout=10)
+        except: return None
+        return self.record_list
+
+    async def request_summaries(self):
+        self.record_list = {}
+        self.list_complete_event.clear()
+        if not self.connected: return None
+        try:
+            await self.client.write_gatt_char(RX_CHAR_UUID, bytes([0x04]), response=True)
+            await asyncio.wait_for(self.list_complete_event.wait(), timeout=10)
+        except: return None
+        return self.record_list
+
+    async def request_sessions(self):
+        # sesiones guardadas en el dispositivo: {id: {...}}
+        self.session_list = {}
+        self.list_complete_event.clear()
+        if not self.connected: return None
+        try:
+            await self.client.write_gatt_char(RX_CHAR_UUID, bytes([0x07]), response=True)
+            await asyncio.wait_for(self.list_complete_event.wait(), timeout=10)
+        except: return None
+        return {s["id"]: s for s in self.session_list.values() if "id" in s}
+
+    async def select_session(self, session_id):
+        # las ordenes 0x02-0x04 actuan sobre la sesion seleccionada
+        if not self.connected: return False
+        try:
+            payload = bytes([0x08]) + int(session_id).to_bytes(4, "little")
+            await self.client.write_gatt_char(RX_CHAR_UUID, payload, response=True)
+            return True
+        except Exception as e:
+            print(f"Error seleccion de sesion: {e}")
+            return False
+
+    async def ack_session(self, session_id):
+        # solo tras recibir todas las secuencias: el dispositivo la marca como descargada
+        if not self.connected or not self.data_complete_event.is_set(): return False
+        try:
+            payload = bytes([0x09]) + int(session_id).to_bytes(4, "little")
+            await self.client.write_gatt_char(RX_CHAR_UUID, payload, response=True)
+            return True
+        except Exception as e:
+            print(f"Error confirmacion de sesion: {e}")
+            return False
+
+    async def send_ptt_calibration(self, sbp_slope, sbp_icpt, dbp_slope, dbp_icpt):
+        # BP = icpt + slope * PAT, slope in mmHg/ms, icpt in mmHg
+        if not self.connected: return False
+        try:
+            payload = bytes([0x05]) + struct.pack("<iiii",
+                int(round(sbp_slope * 1000)), int(round(sbp_icpt * 10)),
+                int(round(dbp_slope * 1000)), int(round(dbp_icpt * 10)))
+            await self.client.write_gatt_char(RX_CHAR_UUID, payload, response=True)
+            return True
+        except Exception as e:
+            print(f"Error calibracion PTT: {e}")
+            return False
+
+    async def send_capture_profile(self, fs_hz, win_len, channels=2, warmup_ms=3800, decim=1):
+        # aplica desde la siguiente medicion; fs 32-250 Hz, ventana 256-1024 muestras
+        # decim > 1: el AFE muestrea a fs*decim (max 250 Hz) y promedia en el chip
+        # con ECG activo fs*decim debe dividir 250 Hz (50, 125 o 250); si no, se ignora
+        if not self.connected: return False
+        try:
+            payload = bytes([0x06]) + struct.pack("<HHHBB", int(fs_hz), int(win_len),
+                                                  int(warmup_ms), int(channels), int(decim))
+            await self.client.write_gatt_char(RX_CHAR_UUID, payload, response=True)
+            return True
+        except Exception as e:
+            print(f"Error perfil de captura: {e}")
+            return False
+
     def notification_handler(self, data):
         if len(data) < 8: return
         kind = data[0]
@@ -94,21 +179,98 @@ class BLEManager:
         payload = data[8:]
         self.last_packet_time = time.time()
 
+        if kind == 4 and len(payload) >= 12:
+            length, ts_ms, crc = struct.unpack("<III", payload[:12])
+            flags = int.from_bytes(data[4:6], "little")
+            self.record_list[seq] = {"length": length, "timestamp_ms": ts_ms, "crc": crc, "flags": flags,
+                                     "ppg_channels": 2, "fs_hz": 125, "win_len": 1024}
+            return
+        elif kind == 12 and len(payload) >= 7:
+            fs_hz, win_len, warmup_ms, ch = struct.unpack("<HHHB", payload[:7])
+            self.record_list.setdefault(seq, {}).update(
+                {"fs_hz": fs_hz, "win_len": win_len, "warmup_ms": warmup_ms, "ppg_channels": ch,
+                 "decim": payload[7] if len(payload) >= 8 else 1})
+            if len(payload) >= 12:
+                t, n, fl = struct.unpack("<hBB", payload[8:12])
+                self.record_list[seq].update({"temp": t / 100.0 if fl & 0x01 else None,
+                                              "temp_n": n, "temp_flags": fl})
+            return
+        elif kind == 13 and len(payload) >= 10:
+            # huecos por desbordamiento de FIFO; muestras perdidas mantienen el ultimo valor
+            lost, hwm, ofl, ufl, pos0, len0 = struct.unpack("<HHBBHH", payload[:10])
+            # coste medido de lectura FIFO por slot PPG, en 0.1 us (0 = no medido)
+            slot_x10 = struct.unpack("<H", payload[10:12])[0] if len(payload) >= 12 else 0
+            self.record_list.setdefault(seq, {}).update(
+                {"fifo_lost": lost, "fifo_hwm": hwm, "fifo_oflow": ofl, "fifo_uflow": ufl,
+                 "fifo_slot_us": slot_x10 / 10.0})
+            return
+        elif kind == 15 and len(payload) >= 12:
+            # frecuencia efectiva medida contra el RTC; 0 = no estimada
+            fs_mhz, t0_ms, pts, jit = struct.unpack("<IIHH", payload[:12])
+            self.record_list.setdefault(seq, {}).update(
+                {"fs_eff": fs_mhz / 1000.0 if fs_mhz else None, "t0_ms": t0_ms,
+                 "ts_points": pts, "jitter_us": jit})
+            return
+        elif kind == 18 and len(payload) >= 4:
+            # despertar del AFE antes de la captura; el maximo de la sesion es el de sus registros
+            wake_us, wake_regs = struct.unpack("<HH", payload[:4])
+            self.record_list.setdefault(seq, {}).update(
+                {"wake_us": wake_us, "wake_regs": wake_regs})
+            return
+        elif kind == 16 and len(payload) >= 12:
+            sid, t_unix, t_ms = struct.unpack("<III", payload[:12])
+            flags = int.from_bytes(data[4:6], "little")
+            self.session_list.setdefault(seq, {}).update(
+                {"id": sid, "start_unix": t_unix or None, "start_ms": t_ms,
+                 "downloaded": bool(flags & 0x01), "selected": bool(flags & 0x02),
+                 "open": bool(flags & 0x04)})
+            return
+        elif kind == 17 and len(payload) >= 12:
+            fs_hz, win_len, warmup_ms, ch, dec, rec, n = struct.unpack("<HHHBBHH", payload[:12])
+            self.session_list.setdefault(seq, {}).update(
+                {"fs_hz": fs_hz, "win_len": win_len, "warmup_ms": warmup_ms, "ppg_channels": ch,
+                 "decim": dec, "recorded": rec, "num_sequences": n})
+            return
+        elif kind == 6 and len(payload) >= 8:
+            hr, spo2, rr, q, fl = struct.unpack("<HHHBB", payload[:8])
+            na = lambda v: None if v == 0xFFFF else v / 10.0
+            self.record_list[seq] = {"hr": na(hr), "spo2": na(spo2), "rr": na(rr), "sqi": q, "low_quality": bool(fl & 0x02), "flags": fl}
+            if len(payload) >= 12:
+                sbp, dbp = struct.unpack("<HH", payload[8:12])
+                self.record_list[seq].update({"sbp": na(sbp), "dbp": na(dbp)})
+            return
+        elif kind == 5:
+            self.loop.call_soon_threadsafe(self.list_complete_event.set)
+            return
+
         if seq not in self.session_buffer:
-            self.session_buffer[seq] = {"ppg1": bytearray(), "ppg2": bytearray(), "temp": None}
+            self.session_buffer[seq] = {"ppg1": bytearray(), "ppg2": bytearray(), "temp": None,
+                                        "ecg_rr": bytearray(), "ecg": bytearray(), "ptt": bytearray(),
+                                        "bioz": bytearray(), "ppg_ext": bytearray(), "ppg_min": 0,
+                                        "gaps": bytearray()}
         
         entry = self.session_buffer[seq]
-        if kind == 1: entry["ppg1"].extend(payload)
+        if kind == 1:
+            entry["ppg1"].extend(payload)
+            entry["ppg_min"] = int.from_bytes(data[6:8], "little") * 12 + 4
         elif kind == 2: entry["ppg2"].extend(payload)
         elif kind == 3 and len(payload)>=4:
+            # NaN: sin lecturas validas del TMP117 en la ventana
             entry["temp"] = struct.unpack("<f", payload[:4])[0]
+        elif kind == 7: entry["ecg_rr"].extend(payload)
+        elif kind == 8: entry["ecg"].extend(payload)
+        elif kind == 9: entry["ptt"].extend(payload)
+        elif kind == 10: entry["bioz"].extend(payload)
+        elif kind == 11: entry["ppg_ext"].extend(payload)
+        elif kind == 14: entry["gaps"].extend(payload)
         elif kind == 0:
             self.seqs_recibidas += 1
             print(f"Seq {seq} OK ({self.seqs_recibidas}/{self.expected_sequences})")
             if self.seqs_recibidas >= self.expected_sequences:
                 self.loop.call_soon_threadsafe(self.data_complete_event.set)
 
-    def process_and_save(self, pid, id_24h):
+    def process_and_save(self, pid, id_24h, profiles=None):
+        # profiles: {seq: {"fs_hz": ...}} de request_list(); sin perfil se asume 125 Hz
         print(f"Procesando {len(self.session_buffer)} secuencias...")
         count = 0
         c = self.db.get_cursor()
@@ -118,9 +280,15 @@ class BLEManager:
             ppg2 = np.frombuffer(d["ppg2"], dtype="<u4").astype(np.int32)
             temp = d["temp"]
             
-            if len(ppg1) < 1024 or temp is None: continue
+            prof = (profiles or {}).get(seq, {})
+            fs = prof.get("fs_hz", 125)
+            if len(ppg1) < 256 or temp is None: continue
+            if d["gaps"]:
+                gaps = list(struct.iter_unpack("<HH", bytes(d["gaps"][:len(d["gaps"]) // 4 * 4])))
+                print(f"Seq {seq}: huecos FIFO (inicio, muestras) {gaps}")
             
-            res = process_single_sequence(ppg1, ppg2, temp)
+            res = process_single_sequence(ppg1, ppg2, temp, fs=fs, fs_eff=prof.get("fs_eff"),
+                                          saltos_corregidos=bool(prof.get("flags", 0) & 0x20))  # REC_FLAG_PPG_JUMPS
             
             c.execute("""INSERT INTO mediciones 
                 (id_paciente, id_medicion_24h, fecha, bpm, spo2, resp, temp, sbp, dbp, num_muestras)
@@ -0,0 +1,119 @@
+import argparse
+import os
+import re
+import numpy as np
+import tensorflow as tf
+from tensorflow.keras.models import load_model
+from config import MODEL_PATH
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC_DIR = os.path.join(HERE, "..", "src")
+PPG_DATA_H = os.path.join(SRC_DIR, "ppg_data.h")
+
+# Ops registered in src/bp_model.cpp
+FW_OPS = {"EXPAND_DIMS", "CONV_2D", "MAX_POOL_2D", "RESHAPE", "SQUEEZE",
+          "UNIDIRECTIONAL_SEQUENCE_LSTM", "REVERSE_V2", "STRIDED_SLICE",
+          "CONCATENATION", "FULLY_CONNECTED", "QUANTIZE", "DEQUANTIZE"}
+N_IN = 1024
+
+def load_ppg_data_h(path):
+    txt = open(path, encoding="utf-8").read()
+    body = txt[txt.index("{") + 1:txt.index("}")]
+    vals = [float(v.rstrip("f")) for v in re.findall(r"-?\d+\.?\d*f?", body)]
+    return np.array(vals, dtype=np.float32)
+
+def representative(base, extra_npz, n=200):
+    rng = np.random.default_rng(0)
+    windows = [base]
+    if extra_npz:
+        windows.extend(np.load(extra_npz)["ppg"].astype(np.float32))
+    def gen():
+        for i in range(n):
+            w = windows[i % len(windows)]
+            dc = w.mean()
+            ac = (w - dc) * rng.uniform(0.5, 2.0)
+            yield [((dc * rng.uniform(0.8, 1.2)) + ac).reshape(1, N_IN, 1).astype(np.float32)]
+    return gen
+
+def convert(model, rep, int8_act):
+    # Fixed batch of 1 so the LSTMs fuse without Shape/Pack/Fill for the state
+    fn = tf.function(lambda x: model(x, training=False))
+    cf = fn.get_concrete_function(tf.TensorSpec([1, N_IN, 1], tf.float32))
+    conv = tf.lite.TFLiteConverter.from_concrete_functions([cf], model)
+    conv.optimizations = [tf.lite.Optimize.DEFAULT]
+    conv.representative_dataset = rep
+    if int8_act:
+        conv.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
+        conv.inference_input_type = tf.int8
+        conv.inference_output_type = tf.int8
+    else:
+        # int8 weights, int16 activations: raw PPG has ~10k-count AC on a
+        # ~1.7M DC, which a single int8 input scale cannot resolve
+        conv.target_spec.supported_ops = [
+            tf.lite.OpsSet.EXPERIMENTAL_TFLITE_BUILTINS_ACTIVATIONS_INT16_WEIGHTS_INT8]
+        conv.inference_input_type = tf.int16
+        conv.inference_output_type = tf.int16
+    return conv.convert()
+
+def run_tflite(blob, x):
+    it = tf.lite.Interpreter(model_content=blob)
+    it.allocate_tensors()
+    inp = it.get_input_details()[0]
+    out = it.get_output_details()[0]
+    s, z = inp["quantization"]
+    q = np.clip(np.round(x / s + z), np.iinfo(inp["dtype"]).min, np.iinfo(inp["dtype"]).max)
+    it.set_tensor(inp["index"], q.astype(inp["dtype"]).reshape(inp["shape"]))
+    it.invoke()
+    s, z = out["quantization"]
+    y = (it.get_tensor(out["index"]).astype(np.float32) - z) * s
+    ops = sorted({d["op_name"] for d in it._get_ops_details()})
+    return y.reshape(-1), inp, ops
+
+def write_c(blob, ref, err, in_step):
+    with open(os.path.join(SRC_DIR, "bp_model_data.h"), "w", newline="\r\n") as f:
+        f.write("#ifndef BP_MODEL_DATA_H\n#define BP_MODEL_DATA_H\n\n")
+        f.write("/* Generated by GUI_FINAL/export_bp_model.py from %s */\n\n" % MODEL_PATH)
+        f.write("/* Keras float output on ppg_data.h; converted model off by %.2f / %.2f mmHg */\n"
+                % (err[0], err[1]))
+        f.write("#define BP_MODEL_KERAS_SBP %.3ff\n" % ref[0])
+        f.write("#define BP_MODEL_KERAS_DBP %.3ff\n\n" % ref[1])
+        f.write("#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n")
+        f.write("extern const unsigned char bp_model_tflite[];\n")
+        f.write("extern const unsigned int bp_model_tflite_len;\n\n")
+        f.write("#ifdef __cplusplus\n}\n#endif\n\n#endif\n")
+    with open(os.path.join(SRC_DIR, "bp_model_data.c"), "w", newline="\r\n") as f:
+        f.write('#include "bp_model_data.h"\n\n')
+        f.write("/* input quantization step %.3f counts */\n" % in_step)
+        f.write("const unsigned char bp_model_tflite[] __attribute__((aligned(16))) = {\n")
+        for i in range(0, len(blob), 16):
+            f.write("  " + " ".join("0x%02x," % b for b in blob[i:i + 16]) + "\n")
+        f.write("};\n\nconst unsigned int bp_model_tflite_len = %d;\n" % len(blob))
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--int8-activations", action="store_true")
+    ap.add_argument("--windows", help="npz with a 'ppg' array of extra 1024-sample windows")
+    args = ap.parse_args()
+
+    model = load_model(os.path.join(HERE, MODEL_PATH), compile=False)
+    x = load_ppg_data_h(PPG_DATA_H)
+
+    blob = convert(model, representative(x, args.windows), args.int8_activations)
+    ref = model.predict(x.reshape(1, N_IN, 1), verbose=0)[0]
+    got, inp, ops = run_tflite(blob, x)
+
+    print("Keras  SBP/DBP: %.2f / %.2f" % (ref[0], ref[1]))
+    print("TFLite SBP/DBP: %.2f / %.2f  (err %.2f / %.2f mmHg)" %
+          (got[0], got[1], got[0] - ref[0], got[1] - ref[1]))
+    print("Flatbuffer: %d bytes, input %s step %.3f counts" %
+          (len(blob), inp["dtype"].__name__, inp["quantization"][0]))
+    print("Ops: " + ", ".join(ops))
+
+    missing = set(ops) - FW_OPS
+    if missing:
+        raise SystemExit("ops not registered in bp_model.cpp: " + ", ".join(sorted(missing)))
+
+    write_c(blob, ref, got - ref, inp["quantization"][0])
+
+if __name__ == "__main__":
+    main()
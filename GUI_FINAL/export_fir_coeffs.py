@@ -0,0 +1,50 @@
+import ast
+import os
+import sys
+
+SRC_PY = os.path.join(os.path.dirname(__file__), "signal_processing.py")
+OUT_H = os.path.join(os.path.dirname(__file__), "..", "src", "ppg_fir_coeffs.h")
+
+TABLES = [
+    ("FIR_COEFFS_BPM", "fir_bpm_q31"),
+    ("FIR_COEFFS_SPO2", "fir_spo2_q31"),
+]
+
+def load_coeffs(path):
+    tree = ast.parse(open(path, encoding="utf-8").read())
+    out = {}
+    for node in tree.body:
+        if not isinstance(node, ast.Assign) or len(node.targets) != 1:
+            continue
+        name = getattr(node.targets[0], "id", None)
+        if name not in dict(TABLES):
+            continue
+        call = node.value
+        out[name] = [float(ast.literal_eval(e)) for e in call.args[0].elts]
+    return out
+
+def to_q31(x):
+    v = int(round(x * 2147483648.0))
+    return max(-2147483648, min(2147483647, v))
+
+def emit(f, c_name, coeffs):
+    # CMSIS FIR kernels expect the taps in time-reversed order
+    q = [to_q31(c) for c in reversed(coeffs)]
+    f.write("static const int32_t %s[%d] = {\n" % (c_name, len(q)))
+    for i in range(0, len(q), 8):
+        f.write("  " + " ".join("%d," % v for v in q[i:i + 8]) + "\n")
+    f.write("};\n\n")
+
+def main():
+    coeffs = load_coeffs(SRC_PY)
+    out = sys.argv[1] if len(sys.argv) > 1 else OUT_H
+    with open(out, "w", newline="\r\n") as f:
+        f.write("#ifndef PPG_FIR_COEFFS_H\n#define PPG_FIR_COEFFS_H\n\n")
+        f.write("/* Generated by GUI_FINAL/export_fir_coeffs.py from signal_processing.py */\n\n")
+        for py_name, c_name in TABLES:
+            emit(f, c_name, coeffs[py_name])
+            f.write("#define %s_TAPS %d\n\n" % (c_name.upper(), len(coeffs[py_name])))
+        f.write("#endif\n")
+
+if __name__ == "__main__":
+    main()
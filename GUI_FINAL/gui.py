@@ -175,13 +175,35 @@ class WearableApp(ctk.CTk):
         lbl = ctk.CTkLabel(self.main_frame, text="Descargando...", text_color="orange")
         lbl.pack()
 
+        c.execute("SELECT CAST(strftime('%s', fecha_inicio) AS INTEGER) FROM configuraciones_medicion WHERE id_paciente=? AND en_espera=1 ORDER BY id DESC LIMIT 1", (pid,))
+        row = c.fetchone()
+        inicio = row[0] if row else None
+
         def task():
-            if self.ble.run_async(self.ble.request_download(total)):
+            # el dispositivo guarda varias sesiones: elegir la que empezo al configurar este paciente
+            sesiones = self.ble.run_async(self.ble.request_sessions())
+            if sesiones is None:
+                lbl.configure(text="Error leyendo sesiones", text_color="red")
+                return
+            cand = [s for s in sesiones.values() if s.get("start_unix") and inicio]
+            ses = min(cand, key=lambda s: abs(s["start_unix"] - inicio)) if cand else None
+            if ses is None or abs(ses["start_unix"] - inicio) >= 600:
+                lbl.configure(text="Sesión no encontrada en el dispositivo", text_color="red")
+                return
+            if not self.ble.run_async(self.ble.select_session(ses["id"])):
+                lbl.configure(text="Error seleccionando sesión", text_color="red")
+                return
+            # solo las secuencias con cabecera valida se envian
+            n = ses.get("recorded", total)
+
+            if self.ble.run_async(self.ble.request_download(n)):
                 c.execute("UPDATE configuraciones_medicion SET en_espera=0 WHERE id_paciente=? AND en_espera=1", (pid,))
                 c.execute("SELECT MAX(id) FROM configuraciones_medicion")
                 id24 = c.fetchone()[0]
                 
-                count = self.ble.process_and_save(pid, id24)
+                perfiles = self.ble.run_async(self.ble.request_list())
+                count = self.ble.process_and_save(pid, id24, perfiles)
+                self.ble.run_async(self.ble.ack_session(ses["id"]))
                 lbl.configure(text=f"Completado. {count} guardados.", text_color="green")
             else:
                 lbl.configure(text="Error descarga", text_color="red")
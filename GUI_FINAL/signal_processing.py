@@ -1,6 +1,6 @@
 import numpy as np
 import pandas as pd
-from scipy.signal import lfilter, find_peaks, butter, filtfilt, sosfiltfilt, welch
+from scipy.signal import lfilter, find_peaks, butter, filtfilt, sosfiltfilt, welch, resample_poly
 import tensorflow as tf
 from tensorflow.keras.models import load_model
 from config import MODEL_PATH
@@ -203,8 +203,8 @@ class SignalProcessor:
         return (x - med) / (1.4826 * mad)
 
     @staticmethod
-    def pick_peaks(x):
-        distance = int(0.35 * 125)
+    def pick_peaks(x, fs=125):
+        distance = int(0.35 * fs)
         iqr = np.subtract(*np.percentile(x, [75, 25]))
         prom = max(0.2, 0.25 * iqr)
         return find_peaks(x, distance=distance, prominence=prom)
@@ -264,11 +264,11 @@ class SignalProcessor:
         return np.mean(spo2_values) if spo2_values else 95.0
 
     @staticmethod
-    def estimate_bpm(ppgA, ppgB):
+    def estimate_bpm(ppgA, ppgB, fs=125):
         def get_q(sig):
             sig_filt = SignalProcessor.apply_fir(sig, FIR_COEFFS_BPM)
             sig_z = SignalProcessor.robust_z(sig_filt)
-            p, props = SignalProcessor.pick_peaks(sig_z)
+            p, props = SignalProcessor.pick_peaks(sig_z, fs)
             return np.mean(props['prominences']) if len(p) else 0, p
         
         qA, pA = get_q(ppgA)
@@ -276,22 +276,36 @@ class SignalProcessor:
         peaks = pB if qB > qA else pA
         
         if len(peaks) >= 2:
-            intervals = np.diff(peaks) / 125
+            intervals = np.diff(peaks) / fs
             valid = intervals[(intervals > 60/220) & (intervals < 60/40)]
             if len(valid): return 60.0 / np.median(valid)
         return None
 
-def process_single_sequence(ppg_red, ppg_ir, temp):
-    ppg_red = np.array(corregir_saltos_ppg(ppg_red), dtype=np.float32)
-    ppg_ir = np.array(corregir_saltos_ppg(ppg_ir), dtype=np.float32)
+def process_single_sequence(ppg_red, ppg_ir, temp, fs=125, fs_eff=None, saltos_corregidos=False):
+    # saltos_corregidos: el firmware ya corrigio los saltos de 4096/1024 al adquirir
+    # (REC_FLAG_PPG_JUMPS); registros anteriores se corrigen aqui
+    if not saltos_corregidos:
+        ppg_red = corregir_saltos_ppg(ppg_red)
+        ppg_ir = corregir_saltos_ppg(ppg_ir)
+    ppg_red = np.asarray(ppg_red, dtype=np.float32)
+    ppg_ir = np.asarray(ppg_ir, dtype=np.float32)
 
-    try: hr = SignalProcessor.estimate_bpm(ppg_red, ppg_ir)
+    # Los FIR y umbrales estan disenados a 125 Hz: otros perfiles se remuestrean
+    if fs != 125:
+        ppg_red = resample_poly(ppg_red, 125, int(fs)).astype(np.float32)
+        ppg_ir = resample_poly(ppg_ir, 125, int(fs)).astype(np.float32)
+
+    # fs_eff: frecuencia real medida por el dispositivo; tras remuestrear la
+    # senal sigue teniendo 125 muestras por segundo nominal
+    fs_true = 125.0 * fs_eff / fs if fs_eff else 125.0
+
+    try: hr = SignalProcessor.estimate_bpm(ppg_red, ppg_ir, fs_true)
     except: hr = None
 
     try: spo2 = SignalProcessor.estimate_spo2(ppg_red, ppg_ir)
     except: spo2 = None
 
-    try: rr = SignalProcessor.rr_from_baseline(ppg_ir)
+    try: rr = SignalProcessor.rr_from_baseline(ppg_ir, fs_true)
     except: rr = None
 
     sbp, dbp = None, None
@@ -302,4 +316,5 @@ def process_single_sequence(ppg_red, ppg_ir, temp):
             sbp, dbp = float(pred[0]), float(pred[1])
         except: pass
 
-    return {"hr": hr, "spo2": spo2, "rr": rr, "temp": float(temp), "sbp": sbp, "dbp": dbp}
\ No newline at end of file
+    temp = float(temp) if temp is not None and np.isfinite(temp) else None
+    return {"hr": hr, "spo2": spo2, "rr": rr, "temp": temp, "sbp": sbp, "dbp": dbp}
\ No newline at end of file
@@ -200,7 +200,7 @@ int32_t adi_adpd6000_ecg_read_fifo(adi_adpd6000_device_t *device, adi_adpd6000_f
             { 
                 if (fifo->ecg_size == 4) 
                 {
-                    *ecg_data++ = (fifo_data[0] << 24) || (fifo_data[1] << 16) | (fifo_data[2] << 8) | (fifo_data[3]);
+                    *ecg_data++ = ((uint32_t)fifo_data[0] << 24) | (fifo_data[1] << 16) | (fifo_data[2] << 8) | (fifo_data[3]);
                 }
                 else
                 {
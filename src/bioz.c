@@ -0,0 +1,135 @@
+#include "Funciones.h"
+
+#include <math.h>
+#include <complex.h>
+
+/*
+ * Single-precision replacements for adi_adpd6000_bioz_cal_ms4/ms6(), which
+ * use double and _Complex double and so run in soft-float on the M4F.
+ *
+ * The ms6 expression reduces algebraically (with d[k] = re - j*im) to
+ *
+ *   Z = Rcal * d0/d5 * (1 + f(d1, d2) + f(d3, d4)),
+ *   f(a, b) = (d5^2 - (a-b)^2) / (d5^2 - 2*d5*(a+b) + (a-b)^2)
+ *
+ * which is homogeneous in d, so the inputs may be raw DFT words or sums of
+ * them, and avoids the fourth-power terms that lose precision in float.
+ */
+#define BIOZ_RAD2DEG    (180.0f / 3.14159265f)
+
+static float bioz_rcal = 2000.0f;
+
+static float    bioz_z[BIOZ_LEN];
+static int64_t  bioz_acc_re[BIOZ_SLOTS];
+static int64_t  bioz_acc_im[BIOZ_SLOTS];
+static uint32_t bioz_acc_n;
+static uint32_t bioz_acc_len = BIOZ_DECIM;
+static uint32_t bioz_n;
+
+/* principal value of atan(y/x), as the SDK computes it, without the divide */
+static float bioz_atan_ratio(float y, float x)
+{
+    float a = atan2f(y, x);
+
+    if (a > 0.5f * 3.14159265f) {
+        a -= 3.14159265f;
+    } else if (a < -0.5f * 3.14159265f) {
+        a += 3.14159265f;
+    }
+    return a;
+}
+
+void bioz_ms4_f(const float re[4], const float im[4], float rcal, float *amp, float *phase)
+{
+    float mod[4], ph[4];
+
+    for (int i = 0; i < 4; i++) {
+        mod[i] = sqrtf(re[i] * re[i] + im[i] * im[i]);
+        ph[i]  = bioz_atan_ratio(-im[i], re[i]);
+    }
+    *amp   = rcal * (mod[1] / mod[0]) * (mod[2] / mod[3]);
+    *phase = (ph[1] + ph[2] - ph[3] - ph[0]) * BIOZ_RAD2DEG;
+}
+
+static float complex bioz_ms6_term(float complex z, float complex a, float complex b)
+{
+    float complex d = a - b;
+    float complex z2 = z * z;
+
+    return (z2 - d * d) / (z2 - 2.0f * z * (a + b) + d * d);
+}
+
+void bioz_ms6_f(const float re[6], const float im[6], float rcal, float *amp, float *phase)
+{
+    float complex d[6];
+
+    for (int i = 0; i < 6; i++) {
+        d[i] = CMPLXF(re[i], -im[i]);
+    }
+
+    float complex z = rcal * d[0] / d[5] *
+                      (1.0f + bioz_ms6_term(d[5], d[1], d[2]) + bioz_ms6_term(d[5], d[3], d[4]));
+
+    *amp   = cabsf(z);
+    *phase = bioz_atan_ratio(cimagf(z), crealf(z)) * BIOZ_RAD2DEG;
+}
+
+void bioz_set_rcal(float rcal)
+{
+    bioz_rcal = rcal;
+}
+
+void bioz_reset(uint32_t frames_per_seq)
+{
+    bioz_acc_len = BIOZ_DECIM * MAX(frames_per_seq, 1u);
+    memset(bioz_acc_re, 0, sizeof(bioz_acc_re));
+    memset(bioz_acc_im, 0, sizeof(bioz_acc_im));
+    bioz_acc_n = 0;
+    bioz_n     = 0;
+}
+
+/*
+ * One AFE frame worth of DFT words, slots ordered Rcal V, body V, Rcal I,
+ * body I. Words are summed coherently over BIOZ_DECIM PPG samples (times the
+ * frames per sample when the PPG decimator is on) and converted once, so
+ * |Z| comes out at PPG_FS_HZ / BIOZ_DECIM.
+ */
+void bioz_push(const int32_t re[BIOZ_SLOTS], const int32_t im[BIOZ_SLOTS])
+{
+    for (int i = 0; i < BIOZ_SLOTS; i++) {
+        bioz_acc_re[i] += re[i];
+        bioz_acc_im[i] += im[i];
+    }
+    if (++bioz_acc_n < bioz_acc_len) {
+        return;
+    }
+
+    if (bioz_n < BIOZ_LEN) {
+        float fre[BIOZ_SLOTS], fim[BIOZ_SLOTS], amp, ph;
+
+        for (int i = 0; i < BIOZ_SLOTS; i++) {
+            fre[i] = (float)bioz_acc_re[i];
+            fim[i] = (float)bioz_acc_im[i];
+        }
+        bioz_ms4_f(fre, fim, bioz_rcal, &amp, &ph);
+        bioz_z[bioz_n++] = isfinite(amp) ? amp : 0.0f;
+    }
+
+    memset(bioz_acc_re, 0, sizeof(bioz_acc_re));
+    memset(bioz_acc_im, 0, sizeof(bioz_acc_im));
+    bioz_acc_n = 0;
+}
+
+uint32_t bioz_get(const float **z)
+{
+    *z = bioz_z;
+    return bioz_n;
+}
+
+uint16_t bioz_rr_x10(void)
+{
+    float x[BIOZ_LEN];
+
+    memcpy(x, bioz_z, bioz_n * sizeof(float));
+    return vitals_rr_estimate(x, bioz_n, (float)PPG_FS_HZ / (float)BIOZ_DECIM);
+}
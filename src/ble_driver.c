@@ -16,6 +16,7 @@ struct bt_conn *current_conn;
 static bool notify_enabled = false;
 
 #define MAX_PENDING_NOTIFS 8
+#define STREAM_READ_CHUNKS 20u
 static atomic_t outstanding_notifications = ATOMIC_INIT(0);
 struct k_sem tx_sem;
 
@@ -23,6 +24,7 @@ struct ble_cmd_msg {
     uint8_t  cmd;
     uint8_t  _pad[3];
     uint32_t num_sequences;
+    uint32_t arg;
 };
 
 K_MSGQ_DEFINE(cmd_msgq, sizeof(struct ble_cmd_msg), 4, 4);
@@ -51,6 +53,9 @@ static int ble_notify_fixed(uint8_t kind,
     if (!current_conn || !notify_enabled) {
         return -ENOTCONN;
     }
+    if (payload_len > CHUNK_SIZE_BYTES) {
+        return -EINVAL;
+    }
 
     if (k_sem_take(&tx_sem, K_MSEC(100)) != 0) {
         return -EBUSY;
@@ -114,80 +119,176 @@ void ble_resume_after_measurement(void)
     ble_start_adv();
 }
 
-static void send_stream_from_flash(uint32_t base_addr,
-                                   uint8_t kind,
-                                   uint16_t seq)
+static int ble_notify_wait(uint8_t kind, uint16_t seq, uint16_t chunk_idx,
+                           uint16_t chunk_max, const uint8_t *payload, size_t payload_len)
+{
+    int err;
+
+    while ((err = ble_notify_fixed(kind, seq, chunk_idx, chunk_max,
+                                   payload, payload_len)) == -EBUSY) {
+        k_msleep(2);
+    }
+    return err;
+}
+
+static int send_stream_from_flash(uint32_t base_addr,
+                                  uint32_t total_bytes,
+                                  uint8_t kind,
+                                  uint16_t seq)
 {
     if (!current_conn || !notify_enabled) {
-        return;
+        return -ENOTCONN;
     }
 
-    uint32_t total_bytes = TOTAL_BYTES_PER_VEC;
-    uint16_t chunk_max   = TOTAL_CHUNK_MAX_IDX;
+    uint16_t chunk_max = (total_bytes + CHUNK_SIZE_BYTES - 1u) / CHUNK_SIZE_BYTES - 1u;
 
-    uint8_t buf[CHUNK_SIZE_BYTES];
+    uint8_t blk[CHUNK_SIZE_BYTES * STREAM_READ_CHUNKS];
 
     for (uint16_t chunk = 0; chunk <= chunk_max; chunk++) {
         uint32_t offset = (uint32_t)chunk * CHUNK_SIZE_BYTES;
-        uint32_t addr   = base_addr + offset;
+        uint16_t blk_idx = chunk % STREAM_READ_CHUNKS;
+
+        if (blk_idx == 0) {
+            size_t blk_len = sizeof(blk);
+            if (offset + blk_len > total_bytes) {
+                blk_len = total_bytes - offset;
+            }
+            flash_read_bytes(base_addr + offset, blk, blk_len);
+        }
 
         size_t n = CHUNK_SIZE_BYTES;
         if (offset + n > total_bytes) {
             n = total_bytes - offset;
         }
 
-        flash_read_bytes(addr, buf, n);
-
-        int err;
-        do {
-            err = ble_notify_fixed(kind, seq, chunk, chunk_max, buf, n);
+        const uint8_t *buf = &blk[blk_idx * CHUNK_SIZE_BYTES];
 
-            if (err == -ENOTCONN) {
-                return;
-            }
-            if (err && err != -EBUSY) {
-                return;
-            }
-            if (err == -EBUSY) {
-                k_msleep(2);
-            }
-        } while (err == -EBUSY);
+        int err = ble_notify_wait(kind, seq, chunk, chunk_max, buf, n);
+        if (err) {
+            return err;
+        }
 
         if ((chunk % 40u) == 0u) {
             k_msleep(1);
         }
     }
+
+    return 0;
 }
 
-static void send_sequence_from_flash(uint16_t seq)
+static int send_sequence_from_flash(uint16_t seq)
 {
     if (!current_conn || !notify_enabled) {
-
-        return;
+        return -ENOTCONN;
     }
 
-    uint32_t base      = FLASH_SEQ_BASE + (uint32_t)seq * SEQ_SLOT_SIZE;
+    const struct rec_hdr *h = rec_index_lookup(seq);
+
+    uint32_t base      = rec_slot_addr(seq);
     uint32_t addr_ppg1 = base;
     uint32_t addr_ppg2 = base + TOTAL_BYTES_PER_VEC;
     uint32_t addr_temp = base + TOTAL_BYTES_PER_VEC * 2u;
+    uint32_t ppg_bytes = TOTAL_BYTES_PER_VEC;
+
+    if (h && h->profile.win_len && h->profile.win_len <= VEC_LEN) {
+        ppg_bytes = h->profile.win_len * BYTES_PER_SAMPLE;
+    }
 
-    send_stream_from_flash(addr_ppg1, 1, seq);
+    int err = send_stream_from_flash(addr_ppg1, ppg_bytes, 1, seq);
+    if (err) {
+        return err;
+    }
     k_msleep(3);
 
-    send_stream_from_flash(addr_ppg2, 2, seq);
+    err = send_stream_from_flash(addr_ppg2, ppg_bytes, 2, seq);
+    if (err) {
+        return err;
+    }
     k_msleep(3);
 
     uint8_t tbuf[4];
     flash_read_bytes(addr_temp, tbuf, 4);
-    (void)ble_notify_fixed(3, seq, 0, 0, tbuf, 4);
+    err = ble_notify_wait(3, seq, 0, 0, tbuf, 4);
+    if (err) {
+        return err;
+    }
+
+    if (h && (h->flags & REC_FLAG_ECG) && h->ecg_rr_count) {
+        uint32_t rr_bytes  = MIN(h->ecg_rr_count, ECG_RR_MAX) * 2u;
+        uint16_t chunk_max = (rr_bytes + CHUNK_SIZE_BYTES - 1u) / CHUNK_SIZE_BYTES - 1u;
+        uint8_t  rbuf[CHUNK_SIZE_BYTES];
+
+        for (uint16_t chunk = 0; chunk <= chunk_max; chunk++) {
+            uint32_t off = (uint32_t)chunk * CHUNK_SIZE_BYTES;
+            size_t   n   = MIN(CHUNK_SIZE_BYTES, rr_bytes - off);
+
+            flash_read_bytes(base + SEQ_ECG_RR_OFF + off, rbuf, n);
+            err = ble_notify_wait(7, seq, chunk, chunk_max, rbuf, n);
+            if (err) {
+                return err;
+            }
+        }
+    }
+    if (h && (h->flags & REC_FLAG_ECG) && h->pat_count) {
+        k_msleep(3);
+        err = send_stream_from_flash(base + SEQ_PTT_OFF,
+                                     MIN(h->pat_count, PTT_BEATS_MAX) * sizeof(struct ptt_beat), 9, seq);
+        if (err) {
+            return err;
+        }
+    }
+    if (h && (h->flags & REC_FLAG_ECG_RAW) && h->ecg_len) {
+        k_msleep(3);
+        err = send_stream_from_flash(base + SEQ_ECG_RAW_OFF,
+                                     MIN(h->ecg_len, ECG_LEN) * BYTES_PER_SAMPLE, 8, seq);
+        if (err) {
+            return err;
+        }
+    }
+    if (h && (h->flags & REC_FLAG_BIOZ)) {
+        k_msleep(3);
+        err = send_stream_from_flash(base + SEQ_BIOZ_OFF, SEQ_BIOZ_BYTES, 10, seq);
+        if (err) {
+            return err;
+        }
+    }
+    for (uint32_t ch = 2; h && ch < MIN(h->profile.channels, PPG_NUM_SLOTS); ch++) {
+        k_msleep(3);
+        err = send_stream_from_flash(base + SEQ_PPG_EXT_OFF + (ch - 2u) * TOTAL_BYTES_PER_VEC,
+                                     ppg_bytes, 11, seq);
+        if (err) {
+            return err;
+        }
+    }
+    if (h && (h->flags & REC_FLAG_FIFO_GAP)) {
+        uint8_t  n_gaps = MIN(h->fifo.oflow, REC_GAP_MAX);
+        uint8_t  gbuf[REC_GAP_MAX * 4u];
+        uint32_t g_bytes = n_gaps * 4u;
+        uint16_t chunk_max = (g_bytes + CHUNK_SIZE_BYTES - 1u) / CHUNK_SIZE_BYTES - 1u;
+
+        for (uint8_t g = 0; g < n_gaps; g++) {
+            sys_put_le16(h->fifo.gap_pos[g], &gbuf[g * 4u]);
+            sys_put_le16(h->fifo.gap_len[g], &gbuf[g * 4u + 2u]);
+        }
+        for (uint16_t chunk = 0; chunk <= chunk_max; chunk++) {
+            uint32_t off = (uint32_t)chunk * CHUNK_SIZE_BYTES;
 
-    (void)ble_notify_fixed(0, seq, 0, 0, NULL, 0);
+            err = ble_notify_wait(14, seq, chunk, chunk_max, &gbuf[off],
+                                  MIN(CHUNK_SIZE_BYTES, g_bytes - off));
+            if (err) {
+                return err;
+            }
+        }
+    }
+
+    return ble_notify_wait(0, seq, 0, 0, NULL, 0);
 }
 
 #define HOLTER_REAL_MEASURES      3u
 #define HOLTER_TEST_INTERVAL_MS   (60u * 1000u)
+#define HOLTER_SQI_RETRIES        2u
 
-static void handle_cmd_store(uint32_t N)
+static void handle_cmd_store(uint32_t N, uint32_t start_unix)
 {
     if (N == 0) {
         return;
@@ -200,39 +301,52 @@ static void handle_cmd_store(uint32_t N)
         return;
     }
 
-    uint64_t needed = (uint64_t)FLASH_SEQ_BASE +
-                      (uint64_t)N * (uint64_t)SEQ_SLOT_SIZE;
-
-    if (needed > FLASH_TOTAL_BYTES) {
-        return;
-    }
+    struct capture_profile prof;
 
-    uint32_t last_addr = (uint32_t)needed;
+    measure_get_profile(&prof);
 
     atomic_set(&holter_done_flag, 0);
     atomic_set(&holter_active_flag, 1);
 
-    for (uint32_t addr = 0; addr < last_addr; addr += FLASH_SECTOR_SIZE) {
-        flash_sector_erase(addr);
-        k_msleep(1);
+    int ret = rec_index_begin_session(N, start_unix, &prof);
+    if (ret) {
+        printk("Session not started (%d)\n", ret);
+        atomic_set(&holter_active_flag, 0);
+        return;
     }
 
-    flash_write_config(N);
+    measure_agc_invalidate();
+    (void)measure_session_start();
 
-    uint32_t real_count = (N < HOLTER_REAL_MEASURES) ? N : HOLTER_REAL_MEASURES;
+    uint32_t first = rec_slot_addr(0);
+    uint32_t last  = rec_slot_addr((uint16_t)N);
 
-    int ret;
+    if (flash_erase_range_async(first, last - first)) {
+        flash_erase_range(first, last - first);
+    }
+
+    uint32_t real_count = (N < HOLTER_REAL_MEASURES) ? N : HOLTER_REAL_MEASURES;
 
     for (uint32_t seq = 0; seq < N; seq++) {
 
         if (seq < real_count) {
+            for (uint32_t tries = 0; ; tries++) {
+                ble_pause_for_measurement();
 
-            ble_pause_for_measurement();
+                ret = measure_ppg_template();
 
-            ret = measure_ppg_template();
+                ble_resume_after_measurement();
 
-            ble_resume_after_measurement();
+                if (ret || !measure_is_low_quality() || tries >= HOLTER_SQI_RETRIES) {
+                    break;
+                }
+                k_msleep(1000);
+            }
         } 
+        ret = flash_erase_wait(rec_slot_addr((uint16_t)(seq + 1u)), K_SECONDS(30));
+        if (ret) {
+            break;
+        }
         ret = flash_store_measurement((uint16_t)seq);
         if (ret) {
             break;
@@ -249,13 +363,15 @@ static void handle_cmd_store(uint32_t N)
         }
     }
 
+    (void)rec_index_end_session();
+
     atomic_set(&holter_active_flag, 0);
     atomic_set(&holter_done_flag, 1);
 }
 
 static void handle_cmd_tx_all(void)
 {
-    uint32_t N = flash_read_config();
+    uint32_t N = rec_index_num_sequences();
 
     if (N == 0 || N > MAX_MEASUREMENTS) {
         return;
@@ -264,7 +380,14 @@ static void handle_cmd_tx_all(void)
     atomic_set(&tx_in_progress_flag, 1);
 
     for (uint32_t seq = 0; seq < N; seq++) {
-        send_sequence_from_flash((uint16_t)seq);
+        if (!rec_index_lookup((uint16_t)seq)) {
+            continue;
+        }
+        int err = send_sequence_from_flash((uint16_t)seq);
+        if (err) {
+            printk("Transfer stopped at seq %u (%d)\n", (unsigned int)seq, err);
+            break;
+        }
         k_msleep(5);
     }
 
@@ -272,6 +395,146 @@ static void handle_cmd_tx_all(void)
     atomic_set(&holter_done_flag, 1);
 }
 
+static void handle_cmd_list(void)
+{
+    uint32_t N = rec_index_num_sequences();
+    uint16_t n_valid = 0;
+
+    for (uint32_t seq = 0; seq < N; seq++) {
+        const struct rec_hdr *h = rec_index_lookup((uint16_t)seq);
+        if (!h) {
+            continue;
+        }
+
+        uint8_t p[12];
+        sys_put_le32(h->length,       &p[0]);
+        sys_put_le32(h->timestamp_ms, &p[4]);
+        sys_put_le32(h->data_crc,     &p[8]);
+
+        if (ble_notify_fixed(4, (uint16_t)seq, h->flags, 0, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+
+        sys_put_le16(h->profile.fs_hz,     &p[0]);
+        sys_put_le16(h->profile.win_len,   &p[2]);
+        sys_put_le16(h->profile.warmup_ms, &p[4]);
+        p[6] = h->profile.channels;
+        p[7] = h->profile.decim;
+        sys_put_le16((uint16_t)h->temp.mean_x100, &p[8]);
+        p[10] = h->temp.count;
+        p[11] = h->temp.flags;
+
+        if (ble_notify_fixed(12, (uint16_t)seq, h->flags, 0, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+
+        sys_put_le16(h->fifo.lost,       &p[0]);
+        sys_put_le16(h->fifo.hwm_bytes,  &p[2]);
+        p[4] = h->fifo.oflow;
+        p[5] = h->fifo.uflow;
+        sys_put_le16(h->fifo.gap_pos[0], &p[6]);
+        sys_put_le16(h->fifo.gap_len[0], &p[8]);
+        sys_put_le16(h->burst.slot_us_x10, &p[10]);
+
+        if (ble_notify_fixed(13, (uint16_t)seq, h->flags, 0, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+
+        sys_put_le32(h->timebase.fs_mhz,    &p[0]);
+        sys_put_le32(h->timebase.t0_ms,     &p[4]);
+        sys_put_le16(h->timebase.points,    &p[8]);
+        sys_put_le16(h->timebase.jitter_us, &p[10]);
+
+        if (ble_notify_fixed(15, (uint16_t)seq, h->flags, 0, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+
+        sys_put_le16(h->wake.us,    &p[0]);
+        sys_put_le16(h->wake.fixed, &p[2]);
+
+        if (ble_notify_fixed(18, (uint16_t)seq, h->flags, 0, p, 4) == -ENOTCONN) {
+            return;
+        }
+        n_valid++;
+    }
+
+    (void)ble_notify_fixed(5, n_valid, (uint16_t)N, 0, NULL, 0);
+}
+
+static void handle_cmd_summary(void)
+{
+    uint32_t N = rec_index_num_sequences();
+    uint16_t n_valid = 0;
+
+    for (uint32_t seq = 0; seq < N; seq++) {
+        const struct rec_hdr *h = rec_index_lookup((uint16_t)seq);
+        if (!h) {
+            continue;
+        }
+
+        uint8_t p[12];
+        sys_put_le16(h->summary.hr_x10,   &p[0]);
+        sys_put_le16(h->summary.spo2_x10, &p[2]);
+        sys_put_le16(h->summary.rr_x10,   &p[4]);
+        p[6] = h->summary.quality;
+        p[7] = h->summary.flags;
+        sys_put_le16(h->sbp_x10,          &p[8]);
+        sys_put_le16(h->dbp_x10,          &p[10]);
+
+        if (ble_notify_fixed(6, (uint16_t)seq, h->flags, 0, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+        n_valid++;
+    }
+
+    (void)ble_notify_fixed(5, n_valid, (uint16_t)N, 0, NULL, 0);
+}
+
+static void handle_cmd_sessions(void)
+{
+    uint32_t n = rec_index_num_sessions();
+
+    for (uint32_t i = 0; i < n; i++) {
+        const struct rec_session_info *s = rec_index_session(i);
+        uint8_t p[12];
+
+        sys_put_le32(s->id,         &p[0]);
+        sys_put_le32(s->start_unix, &p[4]);
+        sys_put_le32(s->start_ms,   &p[8]);
+
+        if (ble_notify_fixed(16, (uint16_t)i, s->flags, s->num_sequences, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+
+        sys_put_le16(s->profile.fs_hz,     &p[0]);
+        sys_put_le16(s->profile.win_len,   &p[2]);
+        sys_put_le16(s->profile.warmup_ms, &p[4]);
+        p[6] = s->profile.channels;
+        p[7] = s->profile.decim;
+        sys_put_le16(s->recorded,          &p[8]);
+        sys_put_le16(s->num_sequences,     &p[10]);
+
+        if (ble_notify_fixed(17, (uint16_t)i, s->flags, s->num_sequences, p, sizeof(p)) == -ENOTCONN) {
+            return;
+        }
+    }
+
+    (void)ble_notify_fixed(5, (uint16_t)n, (uint16_t)n, 0, NULL, 0);
+}
+
+static void handle_cmd_ack(uint32_t session_id)
+{
+    /* the host confirms the session only after it received every sequence */
+    int err = rec_index_select(session_id);
+
+    if (!err) {
+        err = rec_index_mark_downloaded();
+    }
+    if (err) {
+        printk("Session %u not acknowledged (%d)\n", session_id, err);
+    }
+}
+
 static void cmd_worker(void *p1, void *p2, void *p3)
 {
     ARG_UNUSED(p1); ARG_UNUSED(p2); ARG_UNUSED(p3);
@@ -283,11 +546,28 @@ static void cmd_worker(void *p1, void *p2, void *p3)
 
         switch (msg.cmd) {
         case 0x01:
-            handle_cmd_store(msg.num_sequences);
+            handle_cmd_store(msg.num_sequences, msg.arg);
             break;
         case 0x02:
             handle_cmd_tx_all();
             break;
+        case 0x03:
+            handle_cmd_list();
+            break;
+        case 0x04:
+            handle_cmd_summary();
+            break;
+        case 0x07:
+            handle_cmd_sessions();
+            break;
+        case 0x08:
+            if (rec_index_select(msg.arg)) {
+                printk("Session %u not found\n", msg.arg);
+            }
+            break;
+        case 0x09:
+            handle_cmd_ack(msg.arg);
+            break;
         default:
             break;
         }
@@ -322,6 +602,7 @@ static ssize_t ble_rx(struct bt_conn *conn,
         }
         msg.cmd = 0x01;
         msg.num_sequences = sys_get_le32(&data[1]);
+        msg.arg = (len >= 9) ? sys_get_le32(&data[5]) : 0;
         break;
 
     case 0x02:
@@ -329,10 +610,76 @@ static ssize_t ble_rx(struct bt_conn *conn,
         msg.num_sequences = 0;
         break;
 
+    case 0x03:
+        msg.cmd = 0x03;
+        msg.num_sequences = 0;
+        break;
+
+    case 0x04:
+        msg.cmd = 0x04;
+        msg.num_sequences = 0;
+        break;
+
+    case 0x05:
+        if (len < 17) {
+            break;
+        }
+        {
+            struct ptt_cal cal = {
+                .sbp_slope_x1000 = (int32_t)sys_get_le32(&data[1]),
+                .sbp_icpt_x10    = (int32_t)sys_get_le32(&data[5]),
+                .dbp_slope_x1000 = (int32_t)sys_get_le32(&data[9]),
+                .dbp_icpt_x10    = (int32_t)sys_get_le32(&data[13]),
+            };
+            cal.valid = cal.sbp_icpt_x10 != 0 || cal.dbp_icpt_x10 != 0;
+            ptt_set_calibration(&cal);
+        }
+        break;
+
+    case 0x06:
+        if (len < 8) {
+            break;
+        }
+        {
+            struct capture_profile prof = {
+                .fs_hz     = sys_get_le16(&data[1]),
+                .win_len   = sys_get_le16(&data[3]),
+                .warmup_ms = sys_get_le16(&data[5]),
+                .channels  = data[7],
+                .decim     = (len > 8) ? data[8] : 1,
+            };
+            (void)measure_set_profile(&prof);
+        }
+        break;
+
+    case 0x07:
+        msg.cmd = 0x07;
+        break;
+
+    case 0x08:
+        if (len < 5) {
+            break;
+        }
+        msg.cmd = 0x08;
+        msg.arg = sys_get_le32(&data[1]);
+        break;
+
+    case 0x09:
+        if (len < 5) {
+            break;
+        }
+        msg.cmd = 0x09;
+        msg.arg = sys_get_le32(&data[1]);
+        break;
+
     default:
         break;
     }
 
+    if (msg.cmd) {
+        (void)k_msgq_put(&cmd_msgq, &msg, K_NO_WAIT);
+    }
+
     return len;
 }
 
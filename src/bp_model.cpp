@@ -0,0 +1,166 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <errno.h>
+#include <math.h>
+
+/* same condition as BP_MODEL_ENABLE in funciones.h, which stubs the API otherwise */
+#if defined(CONFIG_TENSORFLOW_LITE_MICRO) && __has_include("bp_model_data.h")
+
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/micro/micro_mutable_op_resolver.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+
+#include "bp_model_data.h"
+
+#ifdef CONFIG_BOARD_NATIVE_SIM
+#include "ppg_data.h"
+#endif
+
+/* Largest live pair is conv1d_1: 512x32 in + 512x64 out, 96 KB at int16 */
+#define BP_ARENA_SIZE   (112 * 1024)
+
+/* Max |device - Keras| on the ppg_data.h vector */
+#define BP_SELFTEST_TOL 3.0f
+
+static const tflite::Model *bp_model;
+static tflite::MicroInterpreter *bp_interp;
+static tflite::MicroMutableOpResolver<12> bp_resolver;
+alignas(16) static uint8_t bp_arena[BP_ARENA_SIZE];
+static uint32_t bp_last_us;
+
+static int bp_set_input(TfLiteTensor *in, const int32_t *ppg, uint32_t n)
+{
+    float scale = in->params.scale;
+    int32_t zp  = in->params.zero_point;
+    uint32_t len;
+
+    switch (in->type) {
+    case kTfLiteInt8:
+        len = in->bytes;
+        break;
+    case kTfLiteInt16:
+        len = in->bytes / sizeof(int16_t);
+        break;
+    default:
+        return -ENOTSUP;
+    }
+    if (len != n || scale <= 0.0f) {
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t q = (int32_t)((float)ppg[i] / scale + (ppg[i] >= 0 ? 0.5f : -0.5f)) + zp;
+
+        if (in->type == kTfLiteInt8) {
+            in->data.int8[i] = (int8_t)CLAMP(q, INT8_MIN, INT8_MAX);
+        } else {
+            in->data.i16[i] = (int16_t)CLAMP(q, INT16_MIN, INT16_MAX);
+        }
+    }
+    return 0;
+}
+
+static float bp_get_output(const TfLiteTensor *out, int i)
+{
+    int32_t q = (out->type == kTfLiteInt8) ? out->data.int8[i] : out->data.i16[i];
+
+    return (float)(q - out->params.zero_point) * out->params.scale;
+}
+
+extern "C" int bp_model_infer(const int32_t *ppg, uint32_t n, float *sbp, float *dbp)
+{
+    if (!bp_interp) {
+        return -ENODEV;
+    }
+
+    int ret = bp_set_input(bp_interp->input(0), ppg, n);
+    if (ret) {
+        return ret;
+    }
+
+    uint32_t t0 = k_cycle_get_32();
+    if (bp_interp->Invoke() != kTfLiteOk) {
+        return -EIO;
+    }
+    bp_last_us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
+
+    const TfLiteTensor *out = bp_interp->output(0);
+    *sbp = bp_get_output(out, 0);
+    *dbp = bp_get_output(out, 1);
+    return 0;
+}
+
+extern "C" uint32_t bp_model_last_latency_us(void)
+{
+    return bp_last_us;
+}
+
+extern "C" int bp_model_init(void)
+{
+    bp_model = tflite::GetModel(bp_model_tflite);
+    if (bp_model->version() != TFLITE_SCHEMA_VERSION) {
+        return -EINVAL;
+    }
+
+    /* Conv1D/MaxPooling1D lower to ExpandDims + Conv2D/MaxPool2D + Reshape,
+     * the Bidirectional LSTM to two UnidirectionalSequenceLSTM (the backward
+     * one behind ReverseV2), a StridedSlice of the last step and a Concat.
+     * Keep in sync with FW_OPS in export_bp_model.py.
+     */
+    bp_resolver.AddExpandDims();
+    bp_resolver.AddConv2D();
+    bp_resolver.AddMaxPool2D();
+    bp_resolver.AddReshape();
+    bp_resolver.AddSqueeze();
+    bp_resolver.AddUnidirectionalSequenceLSTM();
+    bp_resolver.AddReverseV2();
+    bp_resolver.AddStridedSlice();
+    bp_resolver.AddConcatenation();
+    bp_resolver.AddFullyConnected();
+    bp_resolver.AddQuantize();
+    bp_resolver.AddDequantize();
+
+    static tflite::MicroInterpreter interp(bp_model, bp_resolver, bp_arena, BP_ARENA_SIZE);
+    if (interp.AllocateTensors() != kTfLiteOk) {
+        printk("BP model: AllocateTensors failed (arena %u bytes)\n",
+               (unsigned int)BP_ARENA_SIZE);
+        return -ENOMEM;
+    }
+    bp_interp = &interp;
+
+    printk("BP model: %u bytes flash, arena %u/%u bytes\n",
+           bp_model_tflite_len,
+           (unsigned int)interp.arena_used_bytes(),
+           (unsigned int)BP_ARENA_SIZE);
+
+#ifdef CONFIG_BOARD_NATIVE_SIM
+    {
+        static int32_t ref_in[1024];
+        float sbp, dbp;
+
+        for (uint32_t i = 0; i < 1024; i++) {
+            ref_in[i] = (int32_t)ppg_data[i];
+        }
+        int ret = bp_model_infer(ref_in, 1024, &sbp, &dbp);
+        if (ret) {
+            return ret;
+        }
+
+        /* BP_MODEL_KERAS_* is the float model's output, not the converter's */
+        bool pass = fabsf(sbp - BP_MODEL_KERAS_SBP) <= BP_SELFTEST_TOL &&
+                    fabsf(dbp - BP_MODEL_KERAS_DBP) <= BP_SELFTEST_TOL;
+
+        printk("BP self-test %s: %d/%d (Keras %d/%d) mmHg x10, %u us\n",
+               pass ? "pass" : "FAIL",
+               (int)(sbp * 10.0f), (int)(dbp * 10.0f),
+               (int)(BP_MODEL_KERAS_SBP * 10.0f), (int)(BP_MODEL_KERAS_DBP * 10.0f),
+               bp_last_us);
+        if (!pass) {
+            return -EIO;
+        }
+    }
+#endif
+    return 0;
+}
+
+#endif /* CONFIG_TENSORFLOW_LITE_MICRO && bp_model_data.h */
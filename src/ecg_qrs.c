@@ -0,0 +1,286 @@
+#include "Funciones.h"
+
+/*
+ * Streaming Pan-Tompkins QRS detector, integer only, at ECG_FS_HZ (250 Hz).
+ *
+ *   band-pass   41-tap moving-average high-pass (~5 Hz) followed by two
+ *               7-tap boxcars (~12 Hz low-pass), both exact in integers
+ *   derivative  (2x[n] + x[n-1] - x[n-3] - 2x[n-4]) / 8
+ *   squaring    64-bit
+ *   integration 150 ms moving window
+ *
+ * Peaks of the integrated signal are classified against the adaptive
+ * SPKI/NPKI thresholds after a 2 s learning phase, with a 200 ms refractory
+ * period and a search-back at THR2 when no beat is seen for 166 % of the
+ * average RR. The R position is refined to the largest band-passed sample
+ * under the integration window.
+ */
+#define ECG_HP_LEN      41u
+#define ECG_HP_DELAY    (ECG_HP_LEN / 2u)
+#define ECG_LP_LEN      7u
+#define ECG_BP_DELAY    (ECG_HP_DELAY + ECG_LP_LEN - 1u)
+#define ECG_MWI_LEN     ((ECG_FS_HZ * 150u) / 1000u)
+#define ECG_RING        128u
+#define ECG_LEARN_LEN   (2u * ECG_FS_HZ)
+#define ECG_REFRACT     (ECG_FS_HZ / 5u)
+#define ECG_RR_AVG_N    8u
+#define ECG_RR_MIN_MS   250u
+#define ECG_RR_MAX_MS   2000u
+
+BUILD_ASSERT(ECG_HP_LEN <= ECG_RING);
+BUILD_ASSERT(ECG_MWI_LEN + ECG_REFRACT + 4u <= ECG_RING);
+
+#define ECG_IDX(i)      ((i) & (ECG_RING - 1u))
+
+struct ecg_peak {
+    uint64_t val;
+    uint32_t r_idx;
+    bool     valid;
+};
+
+static struct {
+    int32_t  x[ECG_RING];
+    int64_t  hp_sum;
+    int32_t  lp1[ECG_LP_LEN];
+    int32_t  lp2[ECG_LP_LEN];
+    int64_t  lp1_sum;
+    int64_t  lp2_sum;
+    int32_t  bp[ECG_RING];
+    uint64_t sq[ECG_RING];
+    uint64_t mwi_sum;
+    uint64_t mwi1, mwi2;
+    uint32_t n;
+
+    uint64_t spki;
+    uint64_t npki;
+    uint64_t learn_max;
+    uint64_t learn_sum;
+
+    struct ecg_peak pend;
+    struct ecg_peak noise;
+    uint32_t last_qrs;
+    bool     have_qrs;
+
+    uint32_t rr_avg[ECG_RR_AVG_N];
+    uint32_t rr_avg_n;
+
+    uint16_t rr_ms[ECG_RR_MAX];
+    uint32_t n_rr;
+    uint32_t r_tick[ECG_RR_MAX + 1u];
+    uint32_t n_r;
+} ecg;
+
+void ecg_qrs_reset(void)
+{
+    memset(&ecg, 0, sizeof(ecg));
+}
+
+static uint32_t ecg_refine_r(uint32_t mwi_idx)
+{
+    uint32_t best = mwi_idx;
+    int32_t  best_abs = -1;
+
+    /* sq[n] is built from bp[n-2]; the window at mwi_idx spans ECG_MWI_LEN sq */
+    for (uint32_t k = 0; k < ECG_MWI_LEN; k++) {
+        uint32_t i = mwi_idx - 2u - k;
+        int32_t v = ecg.bp[ECG_IDX(i)];
+
+        v = (v < 0) ? -v : v;
+        if (v > best_abs) {
+            best_abs = v;
+            best = i;
+        }
+    }
+    return best;
+}
+
+static uint32_t ecg_rr_mean(void)
+{
+    uint32_t n = MIN(ecg.rr_avg_n, ECG_RR_AVG_N);
+    uint32_t s = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        s += ecg.rr_avg[i];
+    }
+    return n ? s / n : 0;
+}
+
+static void ecg_qrs_accept(const struct ecg_peak *p, bool searchback)
+{
+    uint64_t v = p->val;
+
+    if (searchback) {
+        ecg.spki = ecg.spki - (ecg.spki >> 2) + (v >> 2);
+    } else {
+        ecg.spki = ecg.spki - (ecg.spki >> 3) + (v >> 3);
+    }
+
+    if (ecg.have_qrs) {
+        uint32_t rr = p->r_idx - ecg.last_qrs;
+        uint32_t ms = (rr * 1000u) / ECG_FS_HZ;
+
+        ecg.rr_avg[ecg.rr_avg_n % ECG_RR_AVG_N] = rr;
+        ecg.rr_avg_n++;
+
+        if (ecg.n_rr < ECG_RR_MAX) {
+            ecg.rr_ms[ecg.n_rr++] = (uint16_t)MIN(ms, 0xFFFEu);
+        }
+    }
+    if (ecg.n_r < ARRAY_SIZE(ecg.r_tick)) {
+        ecg.r_tick[ecg.n_r++] = p->r_idx - ECG_BP_DELAY;
+    }
+    ecg.last_qrs = p->r_idx;
+    ecg.have_qrs = true;
+    ecg.noise.valid = false;
+}
+
+static void ecg_qrs_peak(uint64_t pk, uint32_t idx)
+{
+    uint64_t thr1 = ecg.npki + ((ecg.spki - MIN(ecg.npki, ecg.spki)) >> 2);
+    uint32_t r = ecg_refine_r(idx);
+
+    if (ecg.have_qrs && r - ecg.last_qrs < ECG_REFRACT) {
+        return;
+    }
+    if (ecg.pend.valid) {
+        if (r - ecg.pend.r_idx >= ECG_REFRACT) {
+            ecg_qrs_accept(&ecg.pend, false);
+            ecg.pend.valid = false;
+        } else if (pk <= ecg.pend.val) {
+            return;
+        }
+    }
+
+    if (pk > thr1) {
+        if (!ecg.pend.valid || pk > ecg.pend.val) {
+            ecg.pend.val   = pk;
+            ecg.pend.r_idx = r;
+            ecg.pend.valid = true;
+        }
+        return;
+    }
+
+    ecg.npki = ecg.npki - (ecg.npki >> 3) + (pk >> 3);
+    if (!ecg.noise.valid || pk > ecg.noise.val) {
+        ecg.noise.val   = pk;
+        ecg.noise.r_idx = r;
+        ecg.noise.valid = true;
+    }
+}
+
+static void ecg_qrs_step(int32_t x)
+{
+    uint32_t n = ecg.n;
+
+    if (n == 0) {
+        for (uint32_t i = 0; i < ECG_RING; i++) {
+            ecg.x[i] = x;
+        }
+        ecg.hp_sum = (int64_t)x * ECG_HP_LEN;
+    }
+
+    ecg.hp_sum += (int64_t)x - ecg.x[ECG_IDX(n - ECG_HP_LEN)];
+    ecg.x[ECG_IDX(n)] = x;
+
+    int32_t hp = (int32_t)((int64_t)ecg.x[ECG_IDX(n - ECG_HP_DELAY)] * ECG_HP_LEN - ecg.hp_sum);
+
+    uint32_t l = n % ECG_LP_LEN;
+    ecg.lp1_sum += (int64_t)hp - ecg.lp1[l];
+    ecg.lp1[l] = hp;
+    int32_t lp1 = (int32_t)(ecg.lp1_sum >> 3);
+    ecg.lp2_sum += (int64_t)lp1 - ecg.lp2[l];
+    ecg.lp2[l] = lp1;
+
+    int32_t bp = (int32_t)(ecg.lp2_sum >> 3);
+    ecg.bp[ECG_IDX(n)] = bp;
+
+    int64_t d = 2 * (int64_t)bp + ecg.bp[ECG_IDX(n - 1u)] -
+                ecg.bp[ECG_IDX(n - 3u)] - 2 * (int64_t)ecg.bp[ECG_IDX(n - 4u)];
+    d >>= 3;
+
+    uint64_t sq = (uint64_t)(d * d);
+    ecg.mwi_sum += sq - ecg.sq[ECG_IDX(n - ECG_MWI_LEN)];
+    ecg.sq[ECG_IDX(n)] = sq;
+
+    uint64_t mwi = ecg.mwi_sum;
+
+    if (n < ECG_LEARN_LEN) {
+        ecg.learn_max  = MAX(ecg.learn_max, mwi);
+        ecg.learn_sum += mwi >> 8;
+        if (n + 1u == ECG_LEARN_LEN) {
+            ecg.spki = ecg.learn_max / 3u;
+            ecg.npki = ((ecg.learn_sum / ECG_LEARN_LEN) << 8) / 2u;
+        }
+    } else if (ecg.mwi1 >= ecg.mwi2 && ecg.mwi1 > mwi) {
+        ecg_qrs_peak(ecg.mwi1, n - 1u);
+    }
+    ecg.mwi2 = ecg.mwi1;
+    ecg.mwi1 = mwi;
+
+    if (ecg.pend.valid && n - ecg.pend.r_idx > ECG_REFRACT + ECG_MWI_LEN) {
+        ecg_qrs_accept(&ecg.pend, false);
+        ecg.pend.valid = false;
+    }
+
+    uint32_t rr_mean = ecg_rr_mean();
+    if (!ecg.pend.valid && ecg.noise.valid && rr_mean &&
+        n - ecg.last_qrs > (rr_mean * 166u) / 100u) {
+        uint64_t thr1 = ecg.npki + ((ecg.spki - MIN(ecg.npki, ecg.spki)) >> 2);
+
+        if (ecg.noise.val > thr1 / 2u) {
+            ecg_qrs_accept(&ecg.noise, true);
+        }
+        ecg.noise.valid = false;
+    }
+
+    ecg.n = n + 1u;
+}
+
+void ecg_qrs_process(const int32_t *x, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        ecg_qrs_step(x[i]);
+    }
+}
+
+uint32_t ecg_qrs_get_rr(const uint16_t **rr_ms)
+{
+    *rr_ms = ecg.rr_ms;
+    return ecg.n_rr;
+}
+
+/* R positions in input samples, i.e. on the FIFO sequence clock */
+uint32_t ecg_qrs_get_r(const uint32_t **ticks)
+{
+    *ticks = ecg.r_tick;
+    return ecg.n_r;
+}
+
+uint16_t ecg_qrs_hr_x10(void)
+{
+    uint16_t v[ECG_RR_MAX];
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < ecg.n_rr; i++) {
+        if (ecg.rr_ms[i] >= ECG_RR_MIN_MS && ecg.rr_ms[i] <= ECG_RR_MAX_MS) {
+            v[n++] = ecg.rr_ms[i];
+        }
+    }
+    if (n < 2u) {
+        return REC_SUM_NA;
+    }
+
+    for (uint32_t i = 1; i < n; i++) {
+        uint16_t t = v[i];
+        uint32_t j = i;
+
+        while (j > 0 && v[j - 1u] > t) {
+            v[j] = v[j - 1u];
+            j--;
+        }
+        v[j] = t;
+    }
+
+    uint32_t med = (n & 1u) ? v[n / 2u] : (v[n / 2u - 1u] + v[n / 2u]) / 2u;
+    return (uint16_t)((600000u + med / 2u) / med);
+}
@@ -4,7 +4,37 @@
 #define CMD_READ_STATUS1   0x05
 #define CMD_PAGE_PROGRAM   0x02
 #define CMD_READ_DATA      0x03
+#define CMD_FAST_READ      0x0B
+#define CMD_READ_SFDP      0x5A
 #define CMD_SECTOR_ERASE   0x20
+#define CMD_BLOCK_ERASE_32K 0x52
+#define CMD_BLOCK_ERASE_64K 0xD8
+#define CMD_CHIP_ERASE     0xC7
+#define CMD_ERASE_SUSPEND  0x75
+#define CMD_ERASE_RESUME   0x7A
+#define CMD_DEEP_POWER_DOWN 0xB9
+#define CMD_RELEASE_DPD    0xAB
+
+#define FLASH_SR_WIP       0x01
+
+#define SFDP_SIGNATURE     0x50444653u
+#define SFDP_BFPT_ID       0xFF00u
+#define SFDP_BFPT_MIN_DW   9u
+#define SFDP_BFPT_SUSP_DW  13u
+#define SFDP_BFPT_MAX_DW   16u
+
+/* spi1 is SPIM1 with a single data line: 8 MHz and no dual/quad lanes. */
+#define FLASH_SPI_BUS_MAX_FREQ   8000000u
+#define FLASH_SPI_BUS_LINES      1u
+#define FLASH_READ_DATA_MAX_FREQ 33000000u
+#define FLASH_FAST_READ_MAX_FREQ 80000000u
+
+#define FLASH_WQ_STACK_SIZE 1024
+#define FLASH_WQ_PRIORITY   7
+#define FLASH_POLL_MIN_US   25u
+
+#define FLASH_DPD_IDLE_MS   200
+#define FLASH_DPD_WAKE_US   35u
 
 #define SPI_BUS_NODE DT_NODELABEL(spi1)
 static const struct device *spi_dev = DEVICE_DT_GET(SPI_BUS_NODE);
@@ -25,6 +55,77 @@ static struct spi_config spi_cfg = {
     },
 };
 
+static struct spi_config spi_read_cfg;
+
+static struct flash_sfdp_params flash_params = {
+    .size_bytes = FLASH_TOTAL_BYTES,
+    .read_cmd   = CMD_READ_DATA,
+    .read_dummy = 0,
+    .read_freq  = 8000000,
+    .erase_cmd  = { CMD_SECTOR_ERASE, CMD_BLOCK_ERASE_32K, CMD_BLOCK_ERASE_64K, 0 },
+    .erase_size = { 4096u, 32768u, 65536u, 0 },
+    .suspend_ok = true,
+    .suspend_cmd = CMD_ERASE_SUSPEND,
+    .resume_cmd  = CMD_ERASE_RESUME,
+    .suspend_latency_us = 30,
+    .resume_interval_us = 100,
+};
+
+/* Bus lock covers each SPI exchange; op lock serialises program/erase. */
+K_MUTEX_DEFINE(flash_bus_mtx);
+K_MUTEX_DEFINE(flash_op_mtx);
+
+static volatile enum flash_op flash_busy_op = FLASH_OP_NONE;
+static int64_t  flash_last_resume;
+static uint32_t flash_suspend_count;
+
+K_THREAD_STACK_DEFINE(flash_wq_stack, FLASH_WQ_STACK_SIZE);
+static struct k_work_q flash_wq;
+
+static struct {
+    struct k_work work;
+    uint32_t start;
+    uint32_t end;
+    uint32_t done;
+    bool     busy;
+} flash_bg;
+
+K_MUTEX_DEFINE(flash_bg_mtx);
+K_CONDVAR_DEFINE(flash_bg_cv);
+
+static void flash_bg_erase_handler(struct k_work *work);
+
+/* Datasheet-typical first poll, then backoff capped at a quarter of it. */
+static struct flash_op_stats flash_stats[FLASH_OP_COUNT] = {
+    [FLASH_OP_PROGRAM]    = { .typ_us = 400u },
+    [FLASH_OP_ERASE_4K]   = { .typ_us = 45000u },
+    [FLASH_OP_ERASE_32K]  = { .typ_us = 120000u },
+    [FLASH_OP_ERASE_64K]  = { .typ_us = 150000u },
+    [FLASH_OP_ERASE_CHIP] = { .typ_us = 40000000u },
+};
+
+static const uint32_t flash_op_max_us[FLASH_OP_COUNT] = {
+    [FLASH_OP_PROGRAM]    = 3000u,
+    [FLASH_OP_ERASE_4K]   = 400000u,
+    [FLASH_OP_ERASE_32K]  = 1600000u,
+    [FLASH_OP_ERASE_64K]  = 2000000u,
+    [FLASH_OP_ERASE_CHIP] = 200000000u,
+};
+
+static void flash_poll_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(flash_poll_work, flash_poll_handler);
+K_SEM_DEFINE(flash_done_sem, 0, 1);
+
+static void flash_idle_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(flash_idle_work, flash_idle_handler);
+
+static bool flash_in_dpd;
+static struct flash_pm_stats flash_pm;
+
+static uint32_t flash_wait_polls;
+static uint32_t flash_wait_step_us;
+static uint32_t flash_wait_step_max_us;
+
 static int spi_write_bytes(const uint8_t *tx, size_t len)
 {
     struct spi_buf buf = {
@@ -61,23 +162,422 @@ static int spi_txrx(const uint8_t *tx, uint8_t *rx, size_t len)
     return spi_transceive(spi_dev, &spi_cfg, &txs, &rxs);
 }
 
+static void flash_dpd_release(void)
+{
+    uint8_t cmd = CMD_RELEASE_DPD;
+
+    spi_write_bytes(&cmd, 1);
+    k_busy_wait(FLASH_DPD_WAKE_US);
+}
+
+static void flash_bus_acquire(void)
+{
+    k_mutex_lock(&flash_bus_mtx, K_FOREVER);
+
+    if (flash_in_dpd) {
+        int64_t t0 = k_uptime_ticks();
+
+        flash_dpd_release();
+        flash_in_dpd = false;
+
+        flash_pm.wakes++;
+        flash_pm.wake_us_total += (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - t0);
+        flash_pm.dpd_ms_total  += (uint32_t)(k_uptime_get() - flash_pm.dpd_since_ms);
+    }
+}
+
+static void flash_bus_release(void)
+{
+    k_work_reschedule(&flash_idle_work, K_MSEC(FLASH_DPD_IDLE_MS));
+    k_mutex_unlock(&flash_bus_mtx);
+}
+
+static bool flash_enter_dpd_locked(void)
+{
+    if (flash_in_dpd) {
+        return true;
+    }
+    if (flash_busy_op != FLASH_OP_NONE || flash_bg.busy) {
+        return false;
+    }
+
+    uint8_t cmd = CMD_DEEP_POWER_DOWN;
+    spi_write_bytes(&cmd, 1);
+
+    flash_in_dpd         = true;
+    flash_pm.dpd_since_ms = k_uptime_get();
+    flash_pm.entries++;
+    return true;
+}
+
+static void flash_idle_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (k_mutex_lock(&flash_op_mtx, K_NO_WAIT)) {
+        k_work_reschedule(&flash_idle_work, K_MSEC(FLASH_DPD_IDLE_MS));
+        return;
+    }
+
+    k_mutex_lock(&flash_bus_mtx, K_FOREVER);
+    bool entered = flash_enter_dpd_locked();
+    k_mutex_unlock(&flash_bus_mtx);
+
+    k_mutex_unlock(&flash_op_mtx);
+
+    if (!entered) {
+        k_work_reschedule(&flash_idle_work, K_MSEC(FLASH_DPD_IDLE_MS));
+    }
+}
+
+int flash_deep_power_down(void)
+{
+    struct k_work_sync sync;
+
+    k_work_cancel_delayable_sync(&flash_idle_work, &sync);
+
+    k_mutex_lock(&flash_op_mtx, K_FOREVER);
+    k_mutex_lock(&flash_bus_mtx, K_FOREVER);
+    bool entered = flash_enter_dpd_locked();
+    k_mutex_unlock(&flash_bus_mtx);
+    k_mutex_unlock(&flash_op_mtx);
+
+    return entered ? 0 : -EBUSY;
+}
+
+const struct flash_pm_stats *flash_get_pm_stats(void)
+{
+    return &flash_pm;
+}
+
+static int flash_read_sfdp(uint32_t addr, uint8_t *dst, size_t len)
+{
+    uint8_t hdr[5] = {
+        CMD_READ_SFDP,
+        (uint8_t)(addr >> 16),
+        (uint8_t)(addr >> 8),
+        (uint8_t)(addr),
+        0
+    };
+
+    struct spi_buf txb[2] = {
+        { .buf = hdr,  .len = sizeof(hdr) },
+        { .buf = NULL, .len = 0 }
+    };
+    struct spi_buf rxb[2] = {
+        { .buf = NULL, .len = sizeof(hdr) },
+        { .buf = dst,  .len = len }
+    };
+
+    struct spi_buf_set txs = { .buffers = txb, .count = 2 };
+    struct spi_buf_set rxs = { .buffers = rxb, .count = 2 };
+
+    return spi_transceive(spi_dev, &spi_cfg, &txs, &rxs);
+}
+
+int flash_sfdp_parse_bfpt(const uint32_t *dw, size_t n_dw,
+                          struct flash_sfdp_params *p)
+{
+    if (!dw || !p || n_dw < SFDP_BFPT_MIN_DW) {
+        return -EINVAL;
+    }
+
+    uint32_t density = dw[1];
+    if (density & BIT(31)) {
+        uint32_t n = density & 0x7FFFFFFFu;
+        if (n < 3u || n > 34u) {
+            return -EINVAL;
+        }
+        p->size_bytes = 1u << (n - 3u);
+    } else {
+        p->size_bytes = (uint32_t)(((uint64_t)density + 1u) / 8u);
+    }
+
+    p->dual_out = (dw[0] & BIT(16)) != 0;
+    p->quad_out = (dw[0] & BIT(22)) != 0;
+
+    uint8_t n_types = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        uint32_t w     = dw[7 + i / 2];
+        uint8_t  shift = (i % 2) * 16;
+        uint8_t  exp   = (uint8_t)(w >> shift);
+        uint8_t  op    = (uint8_t)(w >> (shift + 8));
+
+        if (exp == 0 || exp >= 32) {
+            continue;
+        }
+        p->erase_size[n_types] = 1u << exp;
+        p->erase_cmd[n_types]  = op;
+        n_types++;
+    }
+
+    if (n_types == 0 && (dw[0] & 0x3u) == 0x1u) {
+        p->erase_size[0] = FLASH_SECTOR_SIZE;
+        p->erase_cmd[0]  = (uint8_t)(dw[0] >> 8);
+        n_types = 1;
+    }
+    if (n_types == 0) {
+        return -ENOTSUP;
+    }
+
+    for (uint8_t i = n_types; i < 4; i++) {
+        p->erase_size[i] = 0;
+        p->erase_cmd[i]  = 0;
+    }
+
+    for (uint8_t i = 1; i < n_types; i++) {
+        uint32_t sz = p->erase_size[i];
+        uint8_t  op = p->erase_cmd[i];
+        int8_t   j  = (int8_t)i - 1;
+
+        while (j >= 0 && p->erase_size[j] > sz) {
+            p->erase_size[j + 1] = p->erase_size[j];
+            p->erase_cmd[j + 1]  = p->erase_cmd[j];
+            j--;
+        }
+        p->erase_size[j + 1] = sz;
+        p->erase_cmd[j + 1]  = op;
+    }
+
+    if (n_dw >= SFDP_BFPT_SUSP_DW) {
+        static const uint16_t unit_ns[4] = { 128u, 1000u, 8000u, 64000u };
+        uint32_t dw12 = dw[11];
+        uint32_t dw13 = dw[12];
+
+        p->suspend_ok = (dw12 & BIT(31)) == 0;
+        if (p->suspend_ok) {
+            uint32_t count = ((dw12 >> 24) & 0x1Fu) + 1u;
+            uint32_t unit  = unit_ns[(dw12 >> 29) & 0x3u];
+
+            p->suspend_latency_us = (uint16_t)MIN((count * unit + 999u) / 1000u, 0xFFFFu);
+            p->resume_interval_us = (uint16_t)((((dw12 >> 20) & 0xFu) + 1u) * 64u);
+            p->suspend_cmd        = (uint8_t)(dw13 >> 24);
+            p->resume_cmd         = (uint8_t)(dw13 >> 16);
+        }
+    }
+
+    return 0;
+}
+
+void flash_sfdp_select_read(struct flash_sfdp_params *p,
+                            uint32_t bus_max_freq)
+{
+    if (bus_max_freq > FLASH_READ_DATA_MAX_FREQ) {
+        p->read_cmd   = CMD_FAST_READ;
+        p->read_dummy = 1;
+        p->read_freq  = MIN(bus_max_freq, FLASH_FAST_READ_MAX_FREQ);
+    } else {
+        p->read_cmd   = CMD_READ_DATA;
+        p->read_dummy = 0;
+        p->read_freq  = bus_max_freq;
+    }
+}
+
+#ifdef CONFIG_BOARD_NATIVE_SIM
+/* BFPT of the W25Q128JV on the BOM, 16 DWORDs as in its datasheet SFDP table */
+static const uint32_t w25q128jv_bfpt[SFDP_BFPT_MAX_DW] = {
+    0xFFF920E5u, 0x07FFFFFFu, 0x6B08EB44u, 0xBB423B08u,
+    0xFFFFFFFEu, 0x0000FFFFu, 0xEB40FFFFu, 0x520F200Cu,
+    0x0000D810u, 0x00A60236u, 0xC914EA82u, 0x337663E9u,
+    0x757A757Au, 0x5CD5A2F7u, 0xFF4DF719u, 0xA5F970E9u,
+};
+
+static int flash_sfdp_selftest(void)
+{
+    struct flash_sfdp_params p = {0};
+    int ret = flash_sfdp_parse_bfpt(w25q128jv_bfpt, ARRAY_SIZE(w25q128jv_bfpt), &p);
+
+    flash_sfdp_select_read(&p, FLASH_SPI_BUS_MAX_FREQ);
+
+    bool pass = ret == 0 &&
+                p.size_bytes == 16u * 1024u * 1024u &&
+                p.dual_out && p.quad_out &&
+                p.erase_cmd[0] == CMD_SECTOR_ERASE    && p.erase_size[0] == 4096u &&
+                p.erase_cmd[1] == CMD_BLOCK_ERASE_32K && p.erase_size[1] == 32768u &&
+                p.erase_cmd[2] == CMD_BLOCK_ERASE_64K && p.erase_size[2] == 65536u &&
+                p.erase_cmd[3] == 0 && p.erase_size[3] == 0 &&
+                p.suspend_ok &&
+                p.suspend_cmd == CMD_ERASE_SUSPEND && p.resume_cmd == CMD_ERASE_RESUME &&
+                p.suspend_latency_us == 20u && p.resume_interval_us == 512u &&
+                p.read_cmd == CMD_READ_DATA && p.read_dummy == 0 &&
+                p.read_freq == FLASH_SPI_BUS_MAX_FREQ;
+
+    /* a table cut to the JESD216 minimum must still parse, without suspend data */
+    struct flash_sfdp_params q = {0};
+
+    pass = pass && flash_sfdp_parse_bfpt(w25q128jv_bfpt, SFDP_BFPT_MIN_DW, &q) == 0 &&
+           !q.suspend_ok && q.erase_size[2] == 65536u &&
+           flash_sfdp_parse_bfpt(w25q128jv_bfpt, SFDP_BFPT_MIN_DW - 1u, &q) == -EINVAL;
+
+    printk("SFDP self-test %s: %u KB, erase %u/%u/%u, suspend 0x%02x/0x%02x %u/%u us, read 0x%02x\n",
+           pass ? "pass" : "FAIL", (unsigned int)(p.size_bytes / 1024u),
+           (unsigned int)p.erase_size[0], (unsigned int)p.erase_size[1], (unsigned int)p.erase_size[2],
+           p.suspend_cmd, p.resume_cmd, p.suspend_latency_us, p.resume_interval_us, p.read_cmd);
+    return pass ? 0 : -EIO;
+}
+#endif
+
+static int flash_sfdp_probe(void)
+{
+    uint8_t  hdr[16];
+    uint32_t dw[SFDP_BFPT_MAX_DW];
+
+    int ret = flash_read_sfdp(0, hdr, sizeof(hdr));
+    if (ret) {
+        return ret;
+    }
+
+    if (sys_get_le32(&hdr[0]) != SFDP_SIGNATURE) {
+        return -ENOTSUP;
+    }
+
+    uint16_t id     = ((uint16_t)hdr[15] << 8) | hdr[8];
+    uint8_t  len_dw = hdr[11];
+    uint32_t ptp    = sys_get_le24(&hdr[12]);
+
+    if (id != SFDP_BFPT_ID || len_dw < SFDP_BFPT_MIN_DW) {
+        return -ENOTSUP;
+    }
+    if (len_dw > SFDP_BFPT_MAX_DW) {
+        len_dw = SFDP_BFPT_MAX_DW;
+    }
+
+    ret = flash_read_sfdp(ptp, (uint8_t *)dw, len_dw * 4u);
+    if (ret) {
+        return ret;
+    }
+    for (uint8_t i = 0; i < len_dw; i++) {
+        dw[i] = sys_le32_to_cpu(dw[i]);
+    }
+
+    struct flash_sfdp_params p = flash_params;
+    ret = flash_sfdp_parse_bfpt(dw, len_dw, &p);
+    if (ret) {
+        return ret;
+    }
+
+    flash_params = p;
+    return 0;
+}
+
 void init_spi_flash(void)
 {
+    spi_read_cfg = spi_cfg;
+
+    k_work_init(&flash_bg.work, flash_bg_erase_handler);
+    k_work_queue_start(&flash_wq, flash_wq_stack,
+                       K_THREAD_STACK_SIZEOF(flash_wq_stack),
+                       FLASH_WQ_PRIORITY, NULL);
+
+#ifdef CONFIG_BOARD_NATIVE_SIM
+    (void)flash_sfdp_selftest();
+#endif
+
     if (!device_is_ready(spi_dev)) {
         printk("SPI flash dev not ready\n");
-    } else {
-        printk("SPI flash interface ready\n");
+        return;
     }
+
+    flash_dpd_release();
+
+    int ret = flash_sfdp_probe();
+    if (ret) {
+        printk("SPI flash SFDP not available (%d), legacy read\n", ret);
+    }
+
+    flash_sfdp_select_read(&flash_params, FLASH_SPI_BUS_MAX_FREQ);
+
+    spi_read_cfg.frequency = flash_params.read_freq;
+
+    printk("SPI flash ready: %u KB, read 0x%02x @ %u Hz, dual %d quad %d lanes %u, suspend %d\n",
+           (unsigned int)(flash_params.size_bytes / 1024u),
+           flash_params.read_cmd,
+           (unsigned int)flash_params.read_freq,
+           flash_params.dual_out, flash_params.quad_out,
+           FLASH_SPI_BUS_LINES, flash_params.suspend_ok);
 }
 
-void flash_wait_busy(void)
+const struct flash_sfdp_params *flash_get_params(void)
+{
+    return &flash_params;
+}
+
+static uint8_t flash_read_status(void)
 {
     uint8_t tx[2] = { CMD_READ_STATUS1, 0 };
-    uint8_t rx[2];
+    uint8_t rx[2] = { 0 };
+
+    spi_txrx(tx, rx, 2);
+    return rx[1];
+}
+
+static void flash_poll_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    flash_bus_acquire();
+    bool busy = (flash_read_status() & FLASH_SR_WIP) != 0;
+    if (!busy) {
+        flash_busy_op = FLASH_OP_NONE;
+    }
+    flash_bus_release();
+
+    flash_wait_polls++;
+
+    if (!busy) {
+        k_sem_give(&flash_done_sem);
+        return;
+    }
+
+    k_work_schedule(&flash_poll_work, K_USEC(flash_wait_step_us));
+    flash_wait_step_us = MIN(flash_wait_step_us * 2u, flash_wait_step_max_us);
+}
+
+static int flash_wait_ready(enum flash_op op, int64_t t_start)
+{
+    struct flash_op_stats *st = &flash_stats[op];
+
+    flash_wait_polls       = 0;
+    flash_wait_step_us     = MAX(st->typ_us / 16u, FLASH_POLL_MIN_US);
+    flash_wait_step_max_us = MAX(st->typ_us / 4u, FLASH_POLL_MIN_US);
+
+    k_sem_reset(&flash_done_sem);
+    k_work_schedule(&flash_poll_work, K_USEC(st->typ_us));
+
+    /* On timeout the part may still be busy: keep flash_busy_op and leave
+     * the poll work running so it clears the state once WIP drops.
+     */
+    int ret = k_sem_take(&flash_done_sem, K_USEC(flash_op_max_us[op]));
+    if (ret) {
+        ret = -ETIMEDOUT;
+        st->timeouts++;
+    }
+
+    uint32_t us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - t_start);
+
+    st->count++;
+    st->polls    += flash_wait_polls;
+    st->total_us += us;
+    if (us > st->max_us) {
+        st->max_us = us;
+    }
 
-    do {
-        spi_txrx(tx, rx, 2);
-    } while (rx[1] & 0x01);
+    return ret;
+}
+
+/* Called with flash_op_mtx held, after a previous op timed out */
+static void flash_wait_idle(void)
+{
+    while (flash_busy_op != FLASH_OP_NONE) {
+        k_usleep(FLASH_POLL_MIN_US * 4u);
+    }
+}
+
+void flash_wait_busy(void)
+{
+    k_mutex_lock(&flash_op_mtx, K_FOREVER);
+    flash_wait_idle();
+    k_mutex_unlock(&flash_op_mtx);
 }
 
 void flash_write_enable(void)
@@ -88,6 +588,10 @@ void flash_write_enable(void)
 
 void flash_page_program(uint32_t addr, const uint8_t *data, size_t len)
 {
+    k_mutex_lock(&flash_op_mtx, K_FOREVER);
+    flash_wait_idle();
+    flash_bus_acquire();
+
     flash_write_enable();
 
     uint8_t header[4] = {
@@ -108,7 +612,14 @@ void flash_page_program(uint32_t addr, const uint8_t *data, size_t len)
     };
 
     spi_write(spi_dev, &spi_cfg, &tx_set);
-    flash_wait_busy();
+    flash_busy_op = FLASH_OP_PROGRAM;
+    int64_t t_start = k_uptime_ticks();
+
+    flash_bus_release();
+
+    (void)flash_wait_ready(FLASH_OP_PROGRAM, t_start);
+
+    k_mutex_unlock(&flash_op_mtx);
 }
 
 void flash_write_buffer(uint32_t addr, const uint8_t *data, size_t len)
@@ -126,55 +637,281 @@ void flash_write_buffer(uint32_t addr, const uint8_t *data, size_t len)
     }
 }
 
-void flash_sector_erase(uint32_t addr)
+static enum flash_op flash_erase_op(uint32_t size)
+{
+    if (size <= 4096u) {
+        return FLASH_OP_ERASE_4K;
+    }
+    if (size <= 32768u) {
+        return FLASH_OP_ERASE_32K;
+    }
+    return FLASH_OP_ERASE_64K;
+}
+
+static void flash_erase_cmd(uint8_t opcode, uint32_t addr, size_t cmd_len,
+                            enum flash_op op)
 {
+    k_mutex_lock(&flash_op_mtx, K_FOREVER);
+    flash_wait_idle();
+    flash_bus_acquire();
+
     flash_write_enable();
 
     uint8_t cmd[4] = {
-        CMD_SECTOR_ERASE,
+        opcode,
         (uint8_t)(addr >> 16),
         (uint8_t)(addr >> 8),
         (uint8_t)(addr)
     };
 
-    spi_write_bytes(cmd, 4);
-    flash_wait_busy();
+    spi_write_bytes(cmd, cmd_len);
+    flash_busy_op = op;
+    int64_t t_start = k_uptime_ticks();
+
+    flash_bus_release();
+
+    (void)flash_wait_ready(op, t_start);
+
+    k_mutex_unlock(&flash_op_mtx);
+}
+
+void flash_sector_erase(uint32_t addr)
+{
+    flash_erase_cmd(CMD_SECTOR_ERASE, addr, 4, FLASH_OP_ERASE_4K);
+}
+
+const struct flash_op_stats *flash_get_op_stats(enum flash_op op)
+{
+    if (op >= FLASH_OP_COUNT) {
+        return NULL;
+    }
+    return &flash_stats[op];
+}
+
+void flash_set_op_typical_us(enum flash_op op, uint32_t typ_us)
+{
+    if (op >= FLASH_OP_COUNT || typ_us == 0) {
+        return;
+    }
+    flash_stats[op].typ_us = typ_us;
+}
+
+void flash_reset_op_stats(void)
+{
+    for (uint8_t i = 0; i < FLASH_OP_COUNT; i++) {
+        uint32_t typ = flash_stats[i].typ_us;
+
+        memset(&flash_stats[i], 0, sizeof(flash_stats[i]));
+        flash_stats[i].typ_us = typ;
+    }
+}
+
+static void flash_erase_range_cb(uint32_t addr, uint32_t len,
+                                 void (*progress)(uint32_t erased_to))
+{
+    uint32_t end = addr + len;
+
+    if (addr == 0 && len >= flash_params.size_bytes) {
+        flash_erase_cmd(CMD_CHIP_ERASE, 0, 1, FLASH_OP_ERASE_CHIP);
+        if (progress) {
+            progress(end);
+        }
+        return;
+    }
+
+    while (addr < end) {
+        uint32_t size   = flash_params.erase_size[0];
+        uint8_t  opcode = flash_params.erase_cmd[0];
+
+        for (int8_t i = 3; i >= 0; i--) {
+            uint32_t s = flash_params.erase_size[i];
+            if (s == 0) {
+                continue;
+            }
+            if ((addr % s) == 0 && (end - addr) >= s) {
+                size   = s;
+                opcode = flash_params.erase_cmd[i];
+                break;
+            }
+        }
+
+        flash_erase_cmd(opcode, addr - (addr % size), 4, flash_erase_op(size));
+        addr = addr - (addr % size) + size;
+
+        if (progress) {
+            progress(MIN(addr, end));
+        }
+    }
+}
+
+/* addr must be sector-aligned: rounding it down would erase live data before it */
+int flash_erase_range(uint32_t addr, uint32_t len)
+{
+    if (addr % flash_params.erase_size[0]) {
+        return -EINVAL;
+    }
+    flash_erase_range_cb(addr, len, NULL);
+    return 0;
+}
+
+static void flash_bg_progress(uint32_t erased_to)
+{
+    k_mutex_lock(&flash_bg_mtx, K_FOREVER);
+    flash_bg.done = erased_to;
+    k_condvar_broadcast(&flash_bg_cv);
+    k_mutex_unlock(&flash_bg_mtx);
+}
+
+static void flash_bg_erase_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    flash_erase_range_cb(flash_bg.start, flash_bg.end - flash_bg.start,
+                         flash_bg_progress);
+
+    k_mutex_lock(&flash_bg_mtx, K_FOREVER);
+    flash_bg.busy = false;
+    k_condvar_broadcast(&flash_bg_cv);
+    k_mutex_unlock(&flash_bg_mtx);
+}
+
+int flash_erase_range_async(uint32_t addr, uint32_t len)
+{
+    if (addr % flash_params.erase_size[0]) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&flash_bg_mtx, K_FOREVER);
+    if (flash_bg.busy) {
+        k_mutex_unlock(&flash_bg_mtx);
+        return -EBUSY;
+    }
+    flash_bg.start = addr;
+    flash_bg.end   = addr + len;
+    flash_bg.done  = addr;
+    flash_bg.busy  = true;
+    k_mutex_unlock(&flash_bg_mtx);
+
+    k_work_submit_to_queue(&flash_wq, &flash_bg.work);
+    return 0;
+}
+
+int flash_erase_wait(uint32_t addr_end, k_timeout_t timeout)
+{
+    int ret = 0;
+
+    k_mutex_lock(&flash_bg_mtx, K_FOREVER);
+    while (flash_bg.busy &&
+           addr_end > flash_bg.start && flash_bg.done < addr_end) {
+        ret = k_condvar_wait(&flash_bg_cv, &flash_bg_mtx, timeout);
+        if (ret) {
+            break;
+        }
+    }
+    k_mutex_unlock(&flash_bg_mtx);
+
+    return ret;
+}
+
+static void flash_erase_resume(void);
+
+/* 1 when the erase was suspended, 0 when nothing needed suspending,
+ * -EBUSY when WIP did not drop within the suspend latency.
+ */
+static int flash_erase_suspend(void)
+{
+    if (flash_busy_op == FLASH_OP_NONE || flash_busy_op == FLASH_OP_PROGRAM ||
+        !flash_params.suspend_ok) {
+        return 0;
+    }
+    if (!(flash_read_status() & FLASH_SR_WIP)) {
+        return 0;
+    }
+
+    int64_t since = k_ticks_to_us_floor64(k_uptime_ticks() - flash_last_resume);
+    if (since < flash_params.resume_interval_us) {
+        k_busy_wait((uint32_t)(flash_params.resume_interval_us - since));
+    }
+
+    uint8_t cmd = flash_params.suspend_cmd;
+    spi_write_bytes(&cmd, 1);
+
+    k_busy_wait(flash_params.suspend_latency_us);
+    for (uint8_t i = 0; i < 10u; i++) {
+        if (!(flash_read_status() & FLASH_SR_WIP)) {
+            flash_suspend_count++;
+            return 1;
+        }
+        k_busy_wait(MAX(flash_params.suspend_latency_us / 10u, 10u));
+    }
+
+    /* Still busy: let the erase carry on rather than read a busy array */
+    flash_erase_resume();
+    return -EBUSY;
+}
+
+static void flash_erase_resume(void)
+{
+    uint8_t cmd = flash_params.resume_cmd;
+    spi_write_bytes(&cmd, 1);
+    flash_last_resume = k_uptime_ticks();
 }
 
 void flash_read_bytes(uint32_t addr, uint8_t *dst, size_t len)
 {
-    uint8_t hdr[4] = {
-        CMD_READ_DATA,
+    uint8_t hdr[5] = {
+        flash_params.read_cmd,
         (uint8_t)(addr >> 16),
         (uint8_t)(addr >> 8),
-        (uint8_t)(addr)
+        (uint8_t)(addr),
+        0
     };
+    size_t hdr_len = 4u + flash_params.read_dummy;
 
     struct spi_buf txb[2] = {
-        { .buf = hdr,  .len = 4 },
+        { .buf = hdr,  .len = hdr_len },
         { .buf = NULL, .len = 0 }
     };
     struct spi_buf rxb[2] = {
-        { .buf = NULL, .len = 4 },
+        { .buf = NULL, .len = hdr_len },
         { .buf = dst,  .len = len }
     };
 
     struct spi_buf_set txs = { .buffers = txb, .count = 2 };
     struct spi_buf_set rxs = { .buffers = rxb, .count = 2 };
 
-    spi_transceive(spi_dev, &spi_cfg, &txs, &rxs);
-}
+    flash_bus_acquire();
 
-void flash_write_config(uint32_t num_sequences)
-{
-    flash_write_buffer(FLASH_CFG_ADDR,
-                       (const uint8_t *)&num_sequences,
-                       sizeof(num_sequences));
+    int suspended;
+
+    for (;;) {
+        while (flash_busy_op == FLASH_OP_PROGRAM ||
+               (flash_busy_op != FLASH_OP_NONE && !flash_params.suspend_ok)) {
+            flash_bus_release();
+            k_usleep(FLASH_POLL_MIN_US * 4u);
+            flash_bus_acquire();
+        }
+
+        suspended = flash_erase_suspend();
+        if (suspended != -EBUSY) {
+            break;
+        }
+
+        flash_bus_release();
+        k_usleep(flash_params.resume_interval_us);
+        flash_bus_acquire();
+    }
+
+    spi_transceive(spi_dev, &spi_read_cfg, &txs, &rxs);
+
+    if (suspended > 0) {
+        flash_erase_resume();
+    }
+
+    flash_bus_release();
 }
 
-uint32_t flash_read_config(void)
+uint32_t flash_get_suspend_count(void)
 {
-    uint32_t N = 0;
-    flash_read_bytes(FLASH_CFG_ADDR, (uint8_t *)&N, sizeof(N));
-    return N;
+    return flash_suspend_count;
 }
\ No newline at end of file
@@ -15,7 +15,9 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
 #include <string.h>
+#include <stddef.h>
 #include <errno.h>
 
 #define VEC_LEN           1024
@@ -29,11 +31,299 @@
 #define FLASH_TOTAL_BYTES   (16u * 1024u * 1024u)
 #define FLASH_SECTOR_SIZE   4096u
 #define FLASH_PAGE_SIZE     256u
-#define FLASH_CFG_ADDR      0u
-#define FLASH_SEQ_BASE      FLASH_SECTOR_SIZE
+#define FLASH_IDX_BANK_SIZE (4u * FLASH_SECTOR_SIZE)
+#define FLASH_DIR_BANK_A    0u
+#define FLASH_DIR_BANK_B    FLASH_IDX_BANK_SIZE
+#define FLASH_SES_BASE      (2u * FLASH_IDX_BANK_SIZE)
 #define SEQ_RAW_BYTES       (TOTAL_BYTES_PER_VEC*2u + 4u)
-#define SEQ_SLOT_SIZE       (((SEQ_RAW_BYTES + FLASH_PAGE_SIZE - 1u) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE)
+#define SEQ_ECG_RR_OFF      SEQ_RAW_BYTES
+#define SEQ_ECG_RR_BYTES    (ECG_MODE_ENABLE ? ECG_RR_MAX * 2u : 0u)
+#define SEQ_PTT_OFF         (SEQ_ECG_RR_OFF + SEQ_ECG_RR_BYTES)
+#define SEQ_PTT_BYTES       (ECG_MODE_ENABLE ? PTT_BEATS_MAX * sizeof(struct ptt_beat) : 0u)
+#define SEQ_ECG_RAW_OFF     (SEQ_PTT_OFF + SEQ_PTT_BYTES)
+#define SEQ_ECG_RAW_BYTES   ((ECG_MODE_ENABLE && ECG_STORE_RAW) ? ECG_LEN * BYTES_PER_SAMPLE : 0u)
+#define SEQ_BIOZ_OFF        (SEQ_ECG_RAW_OFF + SEQ_ECG_RAW_BYTES)
+#define SEQ_BIOZ_BYTES      (BIOZ_MODE_ENABLE ? BIOZ_LEN * sizeof(float) : 0u)
+#define SEQ_PPG_EXT_OFF     (SEQ_BIOZ_OFF + SEQ_BIOZ_BYTES)
+#define SEQ_PPG_EXT_BYTES   ((PPG_NUM_SLOTS - 2u) * TOTAL_BYTES_PER_VEC)
+#define SEQ_TOTAL_BYTES     (SEQ_PPG_EXT_OFF + SEQ_PPG_EXT_BYTES)
+#define SEQ_SLOT_SIZE       (((SEQ_TOTAL_BYTES + FLASH_PAGE_SIZE - 1u) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE)
 #define MAX_MEASUREMENTS    96u
+#define REC_SES_EXTENT(n)   ROUND_UP(FLASH_IDX_BANK_SIZE + (uint32_t)(n) * SEQ_SLOT_SIZE, FLASH_SECTOR_SIZE)
+#define REC_SESSIONS_MAX    32u
+#define REC_DIR_ENTRIES     (FLASH_IDX_BANK_SIZE / REC_ENTRY_SIZE - 1u)
+
+#define PPG_FS_HZ           125u
+#define PPG_FS_MIN_HZ       32u
+#define PPG_FS_MAX_HZ       250u
+#define PPG_WIN_MIN         256u
+#define PPG_DECIM_MAX       8u
+#define PPG_WARMUP_MS       3800u
+#define PPG_WARMUP_MAX_MS   10000u
+#define PPG_GREEN_ENABLE    0
+#define PPG_NUM_SLOTS       (2u + PPG_GREEN_ENABLE)
+#define PPG_CH_RED          0u
+#define PPG_CH_IR           1u
+#define PPG_CH_GREEN        2u
+#define PPG_LIT_ENABLE      0
+#define PPG_WRAP_DETECT     3000
+#define PPG_WRAP_STEP       4096
+#define PPG_STEP_DETECT     750
+#define PPG_STEP_SIZE       1024
+#define PPG_FILT_BLOCK      20u
+#define PPG_FILT_DECIM_BPM  5u
+#define PPG_FILT_DECIM_SPO2 4u
+#define PPG_FILT_IN_LEN     ((VEC_LEN / PPG_FILT_BLOCK) * PPG_FILT_BLOCK)
+#define PPG_FILT_OUT_BPM    (PPG_FILT_IN_LEN / PPG_FILT_DECIM_BPM)
+#define PPG_FILT_OUT_SPO2   (PPG_FILT_IN_LEN / PPG_FILT_DECIM_SPO2)
+
+#define ECG_MODE_ENABLE     0
+#define ECG_STORE_RAW       1
+#define ECG_FS_HZ           250u
+#define ECG_OVERSAMPLE      ((ECG_FS_HZ + PPG_FS_HZ - 1u) / PPG_FS_HZ)
+#define ECG_LEN             (VEC_LEN * ECG_OVERSAMPLE)
+#define ECG_SEQ_MAX         8u
+#define ECG_RR_MAX          32u
+#define PTT_BEATS_MAX       ECG_RR_MAX
+
+#define BIOZ_MODE_ENABLE    0
+#define BIOZ_SLOTS          4u
+#define BIOZ_FREQ_HZ        50000u
+#define BIOZ_DECIM          25u
+#define BIOZ_LEN            (VEC_LEN / BIOZ_DECIM)
+
+#define REC_ENTRY_SIZE      128u
+#define REC_MAGIC           0x52585948u
+#define REC_SESSION_MAGIC   0x53585948u
+#define REC_DIR_MAGIC       0x44585948u
+#define REC_DIR_BANK_MAGIC  0x42585948u
+#define REC_COMMITTED       0x00000000u
+
+/* BIT(0) stays unused: early records set it for firmware ambient subtraction */
+#define REC_FLAG_ECG        BIT(1)
+#define REC_FLAG_ECG_RAW    BIT(2)
+#define REC_FLAG_BIOZ       BIT(3)
+#define REC_FLAG_FIFO_GAP   BIT(4)
+#define REC_FLAG_PPG_JUMPS  BIT(5)
+
+#define REC_SES_DOWNLOADED  BIT(0)
+#define REC_SES_SELECTED    BIT(1)
+#define REC_SES_OPEN        BIT(2)
+
+#define TEMP_FLAG_VALID     BIT(0)
+#define TEMP_FLAG_I2C_ERR   BIT(1)
+#define TEMP_FLAG_RANGE     BIT(2)
+
+#define REC_SUM_NA          0xFFFFu
+#define REC_SUM_HR_IR       BIT(0)
+#define REC_SUM_LOW_SQI     BIT(1)
+#define SQI_MIN             50u
+
+struct rec_summary {
+    uint16_t hr_x10;
+    uint16_t spo2_x10;
+    uint16_t rr_x10;
+    uint8_t  quality;
+    uint8_t  flags;
+};
+
+struct capture_profile {
+    uint16_t fs_hz;
+    uint16_t win_len;
+    uint16_t warmup_ms;
+    uint8_t  channels;
+    uint8_t  decim;
+};
+
+struct temp_result {
+    int16_t  mean_x100;
+    uint8_t  count;
+    uint8_t  flags;
+};
+
+/* samples lost to FIFO overflow are held at the last value; gaps in window samples */
+#define REC_GAP_MAX         4u
+
+struct fifo_health {
+    uint16_t lost;
+    uint16_t hwm_bytes;
+    uint8_t  oflow;
+    uint8_t  uflow;
+    uint16_t gap_pos[REC_GAP_MAX];
+    uint16_t gap_len[REC_GAP_MAX];
+};
+
+/* sample i was taken at t0_ms + i * 1000 / fs_eff; fs_mhz == 0 when not estimated */
+struct rec_timebase {
+    uint32_t fs_mhz;
+    uint32_t t0_ms;
+    uint16_t points;
+    uint16_t jitter_us;
+};
+
+/* mean FIFO read cost per sequence, 0.1 us units; all 0 when not measured */
+struct rec_burst {
+    uint16_t seq_bytes;
+    uint16_t burst_us_x10;
+    uint16_t status_us_x10;
+    uint16_t slot_us_x10;
+};
+
+/* AFE wake before the capture: latency and registers restored from the sleep image */
+struct rec_wake {
+    uint16_t us;
+    uint16_t fixed;
+};
+
+struct rec_hdr {
+    uint32_t magic;
+    uint16_t seq;
+    uint16_t flags;
+    uint32_t length;
+    uint32_t timestamp_ms;
+    uint32_t data_crc;
+    struct rec_summary summary;
+    uint16_t sbp_x10;
+    uint16_t dbp_x10;
+    uint32_t amb_red;
+    uint32_t amb_ir;
+    uint8_t  led_current[2];
+    uint8_t  tia_gain[2];
+    uint16_t ecg_hr_x10;
+    uint16_t ecg_len;
+    uint8_t  ecg_rr_count;
+    uint8_t  ecg_status;
+    uint16_t pat_x10;
+    uint8_t  pat_count;
+    uint8_t  reserved0;
+    uint16_t bioz_rr_x10;
+    struct capture_profile profile;
+    struct temp_result temp;
+    struct fifo_health fifo;
+    struct rec_timebase timebase;
+    struct rec_burst burst;
+    uint16_t noise_red;
+    uint16_t noise_ir;
+    struct rec_wake wake;
+    uint32_t hdr_crc;
+    uint32_t commit;
+};
+
+struct ptt_beat {
+    uint16_t pat_x10;
+    uint16_t sbp_x10;
+    uint16_t dbp_x10;
+};
+
+struct ptt_cal {
+    int32_t sbp_slope_x1000;
+    int32_t sbp_icpt_x10;
+    int32_t dbp_slope_x1000;
+    int32_t dbp_icpt_x10;
+    bool    valid;
+};
+
+/* first entry of a session's index area; generation holds the session id */
+struct rec_session_hdr {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t num_sequences;
+    uint32_t start_ms;
+    uint8_t  reserved[104];
+    uint32_t hdr_crc;
+    uint32_t commit;
+};
+
+/*
+ * Session directory: an append-only log in bank A or B. The words after
+ * commit start erased and are each programmed once, in place.
+ */
+struct rec_dir_hdr {
+    uint32_t magic;
+    uint32_t generation;
+    uint8_t  reserved[112];
+    uint32_t hdr_crc;
+    uint32_t commit;
+};
+
+struct rec_dir_entry {
+    uint32_t magic;
+    uint32_t session_id;
+    uint32_t base;
+    uint32_t size;
+    uint32_t num_sequences;
+    uint32_t start_ms;
+    uint32_t start_unix;
+    struct capture_profile profile;
+    uint8_t  reserved[72];
+    uint32_t hdr_crc;
+    uint32_t commit;
+    uint32_t recorded;
+    uint32_t downloaded;
+    uint32_t reclaimed;
+};
+
+struct rec_session_info {
+    uint32_t id;
+    uint32_t base;
+    uint32_t size;
+    uint32_t start_ms;
+    uint32_t start_unix;
+    uint16_t num_sequences;
+    uint16_t recorded;
+    struct capture_profile profile;
+    uint16_t dir_slot;
+    uint8_t  flags;
+};
+
+struct flash_sfdp_params {
+    uint32_t size_bytes;
+    uint8_t  read_cmd;
+    uint8_t  read_dummy;
+    uint32_t read_freq;
+    bool     dual_out;
+    bool     quad_out;
+    uint8_t  erase_cmd[4];
+    uint32_t erase_size[4];
+    bool     suspend_ok;
+    uint8_t  suspend_cmd;
+    uint8_t  resume_cmd;
+    uint16_t suspend_latency_us;
+    uint16_t resume_interval_us;
+};
+
+enum flash_op {
+    FLASH_OP_PROGRAM = 0,
+    FLASH_OP_ERASE_4K,
+    FLASH_OP_ERASE_32K,
+    FLASH_OP_ERASE_64K,
+    FLASH_OP_ERASE_CHIP,
+    FLASH_OP_COUNT,
+    FLASH_OP_NONE = FLASH_OP_COUNT,
+};
+
+struct flash_op_stats {
+    uint32_t typ_us;
+    uint32_t count;
+    uint32_t polls;
+    uint32_t timeouts;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+enum ppg_filt_band {
+    PPG_FILT_BPM = 0,
+    PPG_FILT_SPO2,
+    PPG_FILT_COUNT,
+};
+
+struct flash_pm_stats {
+    uint32_t entries;
+    uint32_t wakes;
+    uint32_t wake_us_total;
+    uint32_t dpd_ms_total;
+    int64_t  dpd_since_ms;
+};
 
 extern atomic_t adpd_error_flag;
 extern atomic_t holter_done_flag;
@@ -51,13 +341,95 @@ void flash_write_enable(void);
 void flash_page_program(uint32_t addr, const uint8_t *data, size_t len);
 void flash_write_buffer(uint32_t addr, const uint8_t *data, size_t len);
 void flash_sector_erase(uint32_t addr);
+int flash_erase_range(uint32_t addr, uint32_t len);
+int flash_erase_range_async(uint32_t addr, uint32_t len);
+int flash_erase_wait(uint32_t addr_end, k_timeout_t timeout);
+uint32_t flash_get_suspend_count(void);
+const struct flash_op_stats *flash_get_op_stats(enum flash_op op);
+void flash_set_op_typical_us(enum flash_op op, uint32_t typ_us);
+void flash_reset_op_stats(void);
+int flash_deep_power_down(void);
+const struct flash_pm_stats *flash_get_pm_stats(void);
 void flash_read_bytes(uint32_t addr, uint8_t *dst, size_t len);
-void flash_write_config(uint32_t num_sequences);
-uint32_t flash_read_config(void);
+int flash_sfdp_parse_bfpt(const uint32_t *dw, size_t n_dw,
+                          struct flash_sfdp_params *p);
+void flash_sfdp_select_read(struct flash_sfdp_params *p,
+                            uint32_t bus_max_freq);
+const struct flash_sfdp_params *flash_get_params(void);
+
+int rec_index_init(void);
+int rec_index_begin_session(uint32_t num_sequences, uint32_t start_unix,
+                            const struct capture_profile *prof);
+int rec_index_end_session(void);
+int rec_index_select(uint32_t session_id);
+int rec_index_mark_downloaded(void);
+uint32_t rec_index_num_sessions(void);
+const struct rec_session_info *rec_index_session(uint32_t i);
+int rec_index_commit(uint16_t seq, struct rec_hdr *h);
+const struct rec_hdr *rec_index_lookup(uint16_t seq);
+uint32_t rec_index_num_sequences(void);
+uint32_t rec_slot_addr(uint16_t seq);
+
+void ppg_filter_reset(void);
+int ppg_filter_process(const int32_t *red, const int32_t *ir, uint32_t n);
+uint32_t ppg_filter_get(enum ppg_filt_band band, const int32_t **red, const int32_t **ir);
+uint32_t ppg_filter_group_delay(enum ppg_filt_band band);
+
+void vitals_reset(const uint32_t full_scale[2]);
+void vitals_update(const int32_t *red_raw, const int32_t *ir_raw);
+void vitals_finish(struct rec_summary *s);
+uint16_t vitals_rr_estimate(float *x, uint32_t n, float fs);
+
+void ecg_qrs_reset(void);
+void ecg_qrs_process(const int32_t *x, uint32_t n);
+uint32_t ecg_qrs_get_rr(const uint16_t **rr_ms);
+uint32_t ecg_qrs_get_r(const uint32_t **ticks);
+uint16_t ecg_qrs_hr_x10(void);
+
+void ptt_set_calibration(const struct ptt_cal *cal);
+void ptt_reset(void);
+void ptt_update(const int32_t *ppg, uint32_t n);
+uint32_t ptt_get_beats(const struct ptt_beat **beats);
+uint16_t ptt_median_pat_x10(void);
+
+void bioz_ms4_f(const float re[4], const float im[4], float rcal, float *amp, float *phase);
+void bioz_ms6_f(const float re[6], const float im[6], float rcal, float *amp, float *phase);
+void bioz_set_rcal(float rcal);
+void bioz_reset(uint32_t frames_per_seq);
+void bioz_push(const int32_t re[BIOZ_SLOTS], const int32_t im[BIOZ_SLOTS]);
+uint32_t bioz_get(const float **z);
+uint16_t bioz_rr_x10(void);
+
+/* stubbed until GUI_FINAL/export_bp_model.py has generated bp_model_data.{h,c} */
+#if defined(CONFIG_TENSORFLOW_LITE_MICRO) && __has_include("bp_model_data.h")
+#define BP_MODEL_ENABLE     1
+#else
+#define BP_MODEL_ENABLE     0
+#endif
+
+#if BP_MODEL_ENABLE
+int bp_model_init(void);
+int bp_model_infer(const int32_t *ppg, uint32_t n, float *sbp, float *dbp);
+uint32_t bp_model_last_latency_us(void);
+#else
+static inline int bp_model_init(void) { return -ENOTSUP; }
+static inline int bp_model_infer(const int32_t *ppg, uint32_t n, float *sbp, float *dbp)
+{
+    ARG_UNUSED(ppg); ARG_UNUSED(n); ARG_UNUSED(sbp); ARG_UNUSED(dbp);
+    return -ENOTSUP;
+}
+#endif
 
 void init_i2c(void);
+void tmp117_start(void);
+void tmp117_stop(struct temp_result *r);
 int adpd6000_init_config(void);
 int measure_ppg_template(void);
+int measure_session_start(void);
+bool measure_is_low_quality(void);
+void measure_agc_invalidate(void);
+int measure_set_profile(const struct capture_profile *p);
+void measure_get_profile(struct capture_profile *p);
 int flash_store_measurement(uint16_t seq);
 
 int ble_init_stack(void);
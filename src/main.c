@@ -56,6 +56,8 @@ int main(void)
     power_latch_init();
     init_led();
     init_spi_flash();
+    (void)rec_index_init();
+    (void)bp_model_init();
     init_i2c();
 
     int adpd_err = adpd6000_init_config();
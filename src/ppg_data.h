@@ -1,7 +1,7 @@
 #ifndef PPG_DATA_H
 #define PPG_DATA_H
 
-float ppg_data[1024] = {
+static const float ppg_data[1024] = {
   1727016.0f, 1727949.0f, 1728991.0f, 1729839.0f, 1730509.0f, 1730860.0f, 1731090.0f, 1731286.0f, 
   1731257.0f, 1731038.0f, 1730877.0f, 1730689.0f, 1730343.0f, 1730077.0f, 1729700.0f, 1729429.0f, 
   1729076.0f, 1728817.0f, 1728308.0f, 1727867.0f, 1727422.0f, 1727165.0f, 1726661.0f, 1726258.0f, 
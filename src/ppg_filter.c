@@ -0,0 +1,139 @@
+#include "Funciones.h"
+#include "ppg_fir_coeffs.h"
+
+#ifdef CONFIG_CMSIS_DSP
+#include <arm_math.h>
+#endif
+
+#define PPG_FIR_MAX_TAPS  MAX(FIR_BPM_Q31_TAPS, FIR_SPO2_Q31_TAPS)
+#define PPG_FIR_STATE_LEN (PPG_FIR_MAX_TAPS + PPG_FILT_BLOCK - 1u)
+
+BUILD_ASSERT(PPG_FILT_BLOCK % PPG_FILT_DECIM_BPM == 0);
+BUILD_ASSERT(PPG_FILT_BLOCK % PPG_FILT_DECIM_SPO2 == 0);
+
+struct ppg_fir {
+    const int32_t *coeffs;
+    uint16_t num_taps;
+    uint8_t  decim;
+    int32_t  state[PPG_FIR_STATE_LEN];
+#ifdef CONFIG_CMSIS_DSP
+    arm_fir_decimate_instance_q31 inst;
+#endif
+};
+
+static struct ppg_fir ppg_fir_tab[PPG_FILT_COUNT][2] = {
+    [PPG_FILT_BPM] = {
+        { .coeffs = fir_bpm_q31, .num_taps = FIR_BPM_Q31_TAPS, .decim = PPG_FILT_DECIM_BPM },
+        { .coeffs = fir_bpm_q31, .num_taps = FIR_BPM_Q31_TAPS, .decim = PPG_FILT_DECIM_BPM },
+    },
+    [PPG_FILT_SPO2] = {
+        { .coeffs = fir_spo2_q31, .num_taps = FIR_SPO2_Q31_TAPS, .decim = PPG_FILT_DECIM_SPO2 },
+        { .coeffs = fir_spo2_q31, .num_taps = FIR_SPO2_Q31_TAPS, .decim = PPG_FILT_DECIM_SPO2 },
+    },
+};
+
+static int32_t ppg_bpm_out[2][PPG_FILT_OUT_BPM];
+static int32_t ppg_spo2_out[2][PPG_FILT_OUT_SPO2];
+static uint32_t ppg_filt_in_count;
+
+static void ppg_fir_reset(struct ppg_fir *f)
+{
+#ifdef CONFIG_CMSIS_DSP
+    (void)arm_fir_decimate_init_q31(&f->inst, f->num_taps, f->decim,
+                                    (q31_t *)f->coeffs, f->state, PPG_FILT_BLOCK);
+#else
+    memset(f->state, 0, sizeof(f->state));
+#endif
+}
+
+static void ppg_fir_prime(struct ppg_fir *f, int32_t x0)
+{
+    for (uint32_t i = 0; i + 1u < f->num_taps; i++) {
+        f->state[i] = x0;
+    }
+}
+
+static void ppg_fir_run(struct ppg_fir *f, const int32_t *in, int32_t *out, uint32_t n)
+{
+#ifdef CONFIG_CMSIS_DSP
+    arm_fir_decimate_q31(&f->inst, (q31_t *)in, out, n);
+#else
+    uint32_t hist = f->num_taps - 1u;
+    int32_t *st = f->state;
+
+    memcpy(&st[hist], in, n * sizeof(int32_t));
+
+    for (uint32_t o = 0; o < n / f->decim; o++) {
+        const int32_t *x = &st[(o + 1u) * f->decim - 1u];
+        int64_t acc = 0;
+
+        for (uint32_t k = 0; k < f->num_taps; k++) {
+            acc += (int64_t)f->coeffs[k] * x[k];
+        }
+        out[o] = (int32_t)(acc >> 31);
+    }
+
+    memmove(st, &st[n], hist * sizeof(int32_t));
+#endif
+}
+
+void ppg_filter_reset(void)
+{
+    for (int b = 0; b < PPG_FILT_COUNT; b++) {
+        ppg_fir_reset(&ppg_fir_tab[b][0]);
+        ppg_fir_reset(&ppg_fir_tab[b][1]);
+    }
+    ppg_filt_in_count = 0;
+}
+
+int ppg_filter_process(const int32_t *red, const int32_t *ir, uint32_t n)
+{
+    if (n != PPG_FILT_BLOCK) {
+        return -EINVAL;
+    }
+    if (ppg_filt_in_count + n > PPG_FILT_IN_LEN) {
+        return -ENOSPC;
+    }
+
+    if (ppg_filt_in_count == 0) {
+        for (int b = 0; b < PPG_FILT_COUNT; b++) {
+            ppg_fir_prime(&ppg_fir_tab[b][0], red[0]);
+            ppg_fir_prime(&ppg_fir_tab[b][1], ir[0]);
+        }
+    }
+
+    uint32_t ob = ppg_filt_in_count / PPG_FILT_DECIM_BPM;
+    uint32_t os = ppg_filt_in_count / PPG_FILT_DECIM_SPO2;
+
+    ppg_fir_run(&ppg_fir_tab[PPG_FILT_BPM][0],  red, &ppg_bpm_out[0][ob],  n);
+    ppg_fir_run(&ppg_fir_tab[PPG_FILT_BPM][1],  ir,  &ppg_bpm_out[1][ob],  n);
+    ppg_fir_run(&ppg_fir_tab[PPG_FILT_SPO2][0], red, &ppg_spo2_out[0][os], n);
+    ppg_fir_run(&ppg_fir_tab[PPG_FILT_SPO2][1], ir,  &ppg_spo2_out[1][os], n);
+
+    ppg_filt_in_count += n;
+    return 0;
+}
+
+uint32_t ppg_filter_get(enum ppg_filt_band band, const int32_t **red, const int32_t **ir)
+{
+    switch (band) {
+    case PPG_FILT_BPM:
+        *red = ppg_bpm_out[0];
+        *ir  = ppg_bpm_out[1];
+        return ppg_filt_in_count / PPG_FILT_DECIM_BPM;
+    case PPG_FILT_SPO2:
+        *red = ppg_spo2_out[0];
+        *ir  = ppg_spo2_out[1];
+        return ppg_filt_in_count / PPG_FILT_DECIM_SPO2;
+    default:
+        return 0;
+    }
+}
+
+uint32_t ppg_filter_group_delay(enum ppg_filt_band band)
+{
+    if (band >= PPG_FILT_COUNT) {
+        return 0;
+    }
+    return (ppg_fir_tab[band][0].num_taps - 1u) / 2u;
+}
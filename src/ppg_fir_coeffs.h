@@ -0,0 +1,144 @@
+#ifndef PPG_FIR_COEFFS_H
+#define PPG_FIR_COEFFS_H
+
+/* Generated by GUI_FINAL/export_fir_coeffs.py from signal_processing.py */
+
+static const int32_t fir_bpm_q31[511] = {
+  153998, 133364, 106385, 74225, 38254, 0, -38895, -76733,
+  -111815, -142502, -167269, -184768, -193874, -193738, -183823, -163937,
+  -134252, -95312, -48027, 6345, 66228, 129777, 194936, 259504,
+  321218, 377835, 427221, 467444, 496858, 514185, 518585, 509713,
+  487759, 453470, 408148, 353627, 292227, 226684, 160061, 95635,
+  36780, -13177, -51089, -74137, -79960, -66783, -33521, 20139,
+  93681, 185740, 294114, 415811, 547135, 683805, 821104, 954057,
+  1077629, 1186932, 1277442, 1345208, 1387045, 1400713, 1385054, 1340095,
+  1267106, 1168607, 1048315, 911053, 762588, 609436, 458619, 317383,
+  192910, 91997, 20755, -15688, -13452, 29871, 115045, 241081,
+  405196, 602849, 827850, 1072552, 1328102, 1584763, 1832289, 2060331,
+  2258868, 2418648, 2531606, 2591259, 2593042, 2534583, 2415894, 2239469,
+  2010281, 1735675, 1425152, 1090059, 743180, 398261, 69460, -229229,
+  -484575, -684700, -819637, -881826, -866526, -772137, -600383, -356379,
+  -48551, 311593, 709815, 1129644, 1552974, 1960761, 2333780, 2653424,
+  2902501, 3066010, 3131847, 3091417, 2940126, 2677720, 2308458, 1841096,
+  1288693, 668220, 0, -693022, -1386136, -2053830, -2670832, -3213159,
+  -3659172, -3990556, -4193202, -4257948, -4181136, -3964959, -3617586, -3153034,
+  -2590794, -1955222, -1274701, -580609, 93875, 715080, 1250219, 1668778,
+  1943860, 2053425, 1981374, 1718426, 1262745, 620283, -195191, -1162377,
+  -2253052, -3432985, -4663130, -5901059, -7102586, -8223516, -9221461, -10057642,
+  -10698608, -11117800, -11296880, -11226787, -10908430, -10353019, -9581971, -8626411,
+  -7526246, -6328858, -5087439, -3859037, -2702366, -1675474, -833350, -225571,
+  105925, 128837, -177818, -822415, -1799889, -3091412, -4664618, -6474369,
+  -8464066, -10567475, -12710998, -14816335, -16803431, -18593616, -20112811, -21294676,
+  -22083591, -22437321, -22329274, -21750238, -20709495, -19235281, -17374511, -15191772,
+  -12767591, -10196008, -7581533, -5035556, -2672345, -604754, 1060207, 2225792,
+  2809741, 2748173, 1998971, 544529, -1606262, -4416899, -7823073, -11733464,
+  -16031511, -20578135, -25215357, -29770716, -34062349, -37904600, -41113964, -43515196,
+  -44947360, -45269629, -44366639, -42153190, -38578139, -33627327, -27325418, -19736580,
+  -10963939, -1147818, 9537225, 20886473, 32670136, 44639309, 56532611, 68083319,
+  79026773, 89107824, 98088090, 105752797, 111916982, 116430863, 119184208, 120109559,
+  119184208, 116430863, 111916982, 105752797, 98088090, 89107824, 79026773, 68083319,
+  56532611, 44639309, 32670136, 20886473, 9537225, -1147818, -10963939, -19736580,
+  -27325418, -33627327, -38578139, -42153190, -44366639, -45269629, -44947360, -43515196,
+  -41113964, -37904600, -34062349, -29770716, -25215357, -20578135, -16031511, -11733464,
+  -7823073, -4416899, -1606262, 544529, 1998971, 2748173, 2809741, 2225792,
+  1060207, -604754, -2672345, -5035556, -7581533, -10196008, -12767591, -15191772,
+  -17374511, -19235281, -20709495, -21750238, -22329274, -22437321, -22083591, -21294676,
+  -20112811, -18593616, -16803431, -14816335, -12710998, -10567475, -8464066, -6474369,
+  -4664618, -3091412, -1799889, -822415, -177818, 128837, 105925, -225571,
+  -833350, -1675474, -2702366, -3859037, -5087439, -6328858, -7526246, -8626411,
+  -9581971, -10353019, -10908430, -11226787, -11296880, -11117800, -10698608, -10057642,
+  -9221461, -8223516, -7102586, -5901059, -4663130, -3432985, -2253052, -1162377,
+  -195191, 620283, 1262745, 1718426, 1981374, 2053425, 1943860, 1668778,
+  1250219, 715080, 93875, -580609, -1274701, -1955222, -2590794, -3153034,
+  -3617586, -3964959, -4181136, -4257948, -4193202, -3990556, -3659172, -3213159,
+  -2670832, -2053830, -1386136, -693022, 0, 668220, 1288693, 1841096,
+  2308458, 2677720, 2940126, 3091417, 3131847, 3066010, 2902501, 2653424,
+  2333780, 1960761, 1552974, 1129644, 709815, 311593, -48551, -356379,
+  -600383, -772137, -866526, -881826, -819637, -684700, -484575, -229229,
+  69460, 398261, 743180, 1090059, 1425152, 1735675, 2010281, 2239469,
+  2415894, 2534583, 2593042, 2591259, 2531606, 2418648, 2258868, 2060331,
+  1832289, 1584763, 1328102, 1072552, 827850, 602849, 405196, 241081,
+  115045, 29871, -13452, -15688, 20755, 91997, 192910, 317383,
+  458619, 609436, 762588, 911053, 1048315, 1168607, 1267106, 1340095,
+  1385054, 1400713, 1387045, 1345208, 1277442, 1186932, 1077629, 954057,
+  821104, 683805, 547135, 415811, 294114, 185740, 93681, 20139,
+  -33521, -66783, -79960, -74137, -51089, -13177, 36780, 95635,
+  160061, 226684, 292227, 353627, 408148, 453470, 487759, 509713,
+  518585, 514185, 496858, 467444, 427221, 377835, 321218, 259504,
+  194936, 129777, 66228, 6345, -48027, -95312, -134252, -163937,
+  -183823, -193738, -193874, -184768, -167269, -142502, -111815, -76733,
+  -38895, 0, 38254, 74225, 106385, 133364, 153998,
+};
+
+#define FIR_BPM_Q31_TAPS 511
+
+static const int32_t fir_spo2_q31[511] = {
+  99158, 173246, 199755, 172969, 100163, 0, -101842, -178813,
+  -209951, -185116, -107703, 5872, 129877, 235340, 297090, 300084,
+  243440, 141126, 19016, -91098, -159183, -164496, -101115, 19988,
+  172992, 323052, 434639, 480411, 448446, 345944, 198297, 43558,
+  -76545, -126956, -88456, 36705, 224322, 433267, 615057, 725758,
+  737353, 645645, 472535, 261789, 69043, -51721, -61978, 50758,
+  268422, 545427, 818842, 1023517, 1108537, 1050902, 862798, 590280,
+  303258, 78906, -17630, 49577, 276616, 618737, 999710, 1329659,
+  1527268, 1540893, 1363160, 1034993, 637536, 273441, 41770, 12603,
+  207814, 593205, 1084542, 1566620, 1921097, 2056444, 1932445, 1572788,
+  1061968, 526579, 105045, -87035, 12700, 395130, 978769, 1627231,
+  2181435, 2498980, 2491022, 2147147, 1541398, 817117, 153537, -278174,
+  -358687, -52986, 577187, 1384920, 2171809, 2736099, 2923673, 2669057,
+  2015632, 1109070, 164580, -584807, -946547, -818977, -220698, 709338,
+  1742218, 2613449, 3088476, 3023201, 2403955, 1356018, 117298, -1017499,
+  -1769226, -1945483, -1492585, -514419, 747825, 1971414, 2830555, 3078594,
+  2613299, 1508084, 0, -1564058, -2810900, -3434318, -3274886, -2365620,
+  -930715, 664038, 1998409, 2701807, 2548621, 1520428, -181824, -2180567,
+  -4010467, -5232649, -5546353, -4869792, -3368667, -1423296, 459574, 1770011,
+  2123368, 1361785, -397853, -2783488, -5252501, -7222344, -8215929, -7985670,
+  -6584134, -4361610, -1888568, 180147, 1267289, 1021478, -586051, -3242456,
+  -6359638, -9212335, -11115780, -11599668, -10534492, -8176723, -5118477, -2150829,
+  -71968, 513573, -645541, -3370812, -7082563, -10930621, -13998037, -15529386,
+  -15127203, -12865940, -9291645, -5302990, -1938944, -122756, -424845, -2904914,
+  -7076099, -12005081, -16528548, -19536417, -20253496, -18448820, -14517112, -9406504,
+  -4404087, -826916, 308166, -1445934, -5827912, -11900958, -18256752, -23347384,
+  -25868090, -25097425, -21107727, -14786943, -7657048, -1524245, 1960245, 1723794,
+  -2426129, -9704236, -18488907, -26680880, -32202141, -33519066, -30061333, -22426463,
+  -12306247, -2135941, 5464776, 8334744, 5345488, -3239171, -15721179, -29277045,
+  -40567905, -46525412, -45136996, -36041359, -20776183, -2590074, 14173987, 25016622,
+  26352533, 16480288, -3776272, -30925999, -59240784, -81711525, -91366685, -82703096,
+  -52940430, -2831911, 63157990, 137377449, 210142296, 271322799, 312071329, 326365438,
+  312071329, 271322799, 210142296, 137377449, 63157990, -2831911, -52940430, -82703096,
+  -91366685, -81711525, -59240784, -30925999, -3776272, 16480288, 26352533, 25016622,
+  14173987, -2590074, -20776183, -36041359, -45136996, -46525412, -40567905, -29277045,
+  -15721179, -3239171, 5345488, 8334744, 5464776, -2135941, -12306247, -22426463,
+  -30061333, -33519066, -32202141, -26680880, -18488907, -9704236, -2426129, 1723794,
+  1960245, -1524245, -7657048, -14786943, -21107727, -25097425, -25868090, -23347384,
+  -18256752, -11900958, -5827912, -1445934, 308166, -826916, -4404087, -9406504,
+  -14517112, -18448820, -20253496, -19536417, -16528548, -12005081, -7076099, -2904914,
+  -424845, -122756, -1938944, -5302990, -9291645, -12865940, -15127203, -15529386,
+  -13998037, -10930621, -7082563, -3370812, -645541, 513573, -71968, -2150829,
+  -5118477, -8176723, -10534492, -11599668, -11115780, -9212335, -6359638, -3242456,
+  -586051, 1021478, 1267289, 180147, -1888568, -4361610, -6584134, -7985670,
+  -8215929, -7222344, -5252501, -2783488, -397853, 1361785, 2123368, 1770011,
+  459574, -1423296, -3368667, -4869792, -5546353, -5232649, -4010467, -2180567,
+  -181824, 1520428, 2548621, 2701807, 1998409, 664038, -930715, -2365620,
+  -3274886, -3434318, -2810900, -1564058, 0, 1508084, 2613299, 3078594,
+  2830555, 1971414, 747825, -514419, -1492585, -1945483, -1769226, -1017499,
+  117298, 1356018, 2403955, 3023201, 3088476, 2613449, 1742218, 709338,
+  -220698, -818977, -946547, -584807, 164580, 1109070, 2015632, 2669057,
+  2923673, 2736099, 2171809, 1384920, 577187, -52986, -358687, -278174,
+  153537, 817117, 1541398, 2147147, 2491022, 2498980, 2181435, 1627231,
+  978769, 395130, 12700, -87035, 105045, 526579, 1061968, 1572788,
+  1932445, 2056444, 1921097, 1566620, 1084542, 593205, 207814, 12603,
+  41770, 273441, 637536, 1034993, 1363160, 1540893, 1527268, 1329659,
+  999710, 618737, 276616, 49577, -17630, 78906, 303258, 590280,
+  862798, 1050902, 1108537, 1023517, 818842, 545427, 268422, 50758,
+  -61978, -51721, 69043, 261789, 472535, 645645, 737353, 725758,
+  615057, 433267, 224322, 36705, -88456, -126956, -76545, 43558,
+  198297, 345944, 448446, 480411, 434639, 323052, 172992, 19988,
+  -101115, -164496, -159183, -91098, 19016, 141126, 243440, 300084,
+  297090, 235340, 129877, 5872, -107703, -185116, -209951, -178813,
+  -101842, 0, 100163, 172969, 199755, 173246, 99158,
+};
+
+#define FIR_SPO2_Q31_TAPS 511
+
+#endif
@@ -0,0 +1,149 @@
+#include "Funciones.h"
+
+/*
+ * Pulse arrival time: ECG R peak to the foot of the following PPG upstroke.
+ * Both are placed on the FIFO sequence clock: every sequence carries
+ * ECG_OVERSAMPLE ECG samples followed by one PPG sample, so PPG sample i
+ * sits at ECG tick i * ECG_OVERSAMPLE. The foot is the intersecting-tangent
+ * point of the upstroke (trough level vs. steepest slope), interpolated
+ * between PPG samples.
+ */
+#define PTT_PAT_MIN_MS  100u
+#define PTT_PAT_MAX_MS  450u
+#define PTT_WIN_LO      ((PTT_PAT_MIN_MS * PPG_FS_HZ) / 1000u)
+#define PTT_WIN_HI      ((PTT_PAT_MAX_MS * PPG_FS_HZ) / 1000u)
+#define PTT_TICK_MS     (1000.0f / (float)ECG_FS_HZ)
+
+static struct ptt_cal ptt_cal;
+static struct k_spinlock ptt_lock;
+
+static struct ptt_beat ptt_beats[PTT_BEATS_MAX];
+static uint32_t ptt_n_beats;
+static uint32_t ptt_next_r;
+
+void ptt_set_calibration(const struct ptt_cal *cal)
+{
+    k_spinlock_key_t key = k_spin_lock(&ptt_lock);
+
+    ptt_cal = *cal;
+    k_spin_unlock(&ptt_lock, key);
+}
+
+void ptt_reset(void)
+{
+    memset(ptt_beats, 0xFF, sizeof(ptt_beats));
+    ptt_n_beats = 0;
+    ptt_next_r  = 0;
+}
+
+static float ptt_smooth(const int32_t *x, uint32_t i)
+{
+    return 0.25f * ((float)x[i - 1u] + 2.0f * (float)x[i] + (float)x[i + 1u]);
+}
+
+/* foot position in PPG samples, or a negative value if no upstroke is found */
+static float ptt_find_foot(const int32_t *ppg, uint32_t lo, uint32_t hi)
+{
+    float best_d = 0.0f, s_up = 0.0f;
+    uint32_t i_up = 0;
+
+    for (uint32_t i = lo; i <= hi; i++) {
+        float d = 0.5f * (ptt_smooth(ppg, i + 1u) - ptt_smooth(ppg, i - 1u));
+
+        if (d > best_d) {
+            best_d = d;
+            i_up   = i;
+            s_up   = ptt_smooth(ppg, i);
+        }
+    }
+    if (best_d <= 0.0f) {
+        return -1.0f;
+    }
+
+    float s_min = s_up;
+    uint32_t i_min = i_up;
+
+    for (uint32_t i = i_up; i > lo; i--) {
+        float s = ptt_smooth(ppg, i - 1u);
+
+        if (s < s_min) {
+            s_min = s;
+            i_min = i - 1u;
+        }
+    }
+
+    float t = (float)i_up - (s_up - s_min) / best_d;
+    return CLAMP(t, (float)i_min, (float)i_up);
+}
+
+static uint16_t ptt_apply(int32_t slope_x1000, int32_t icpt_x10, uint16_t pat_x10)
+{
+    int32_t v = icpt_x10 + (slope_x1000 * (int32_t)pat_x10) / 1000;
+
+    return (v > 0 && v < (int32_t)REC_SUM_NA) ? (uint16_t)v : REC_SUM_NA;
+}
+
+void ptt_update(const int32_t *ppg, uint32_t n)
+{
+    const uint32_t *r_tick;
+    uint32_t n_r = ecg_qrs_get_r(&r_tick);
+    struct ptt_cal cal;
+    k_spinlock_key_t key = k_spin_lock(&ptt_lock);
+
+    cal = ptt_cal;
+    k_spin_unlock(&ptt_lock, key);
+
+    while (ptt_next_r < n_r && ptt_n_beats < PTT_BEATS_MAX) {
+        uint32_t r  = r_tick[ptt_next_r];
+        uint32_t lo = r / ECG_OVERSAMPLE + PTT_WIN_LO;
+        uint32_t hi = r / ECG_OVERSAMPLE + PTT_WIN_HI;
+
+        if (hi + 3u > n) {
+            break;
+        }
+        ptt_next_r++;
+
+        float foot = ptt_find_foot(ppg, lo, hi);
+        if (foot < 0.0f) {
+            continue;
+        }
+
+        float pat_ms = (foot * (float)ECG_OVERSAMPLE - (float)r) * PTT_TICK_MS;
+        if (pat_ms < (float)PTT_PAT_MIN_MS || pat_ms > (float)PTT_PAT_MAX_MS) {
+            continue;
+        }
+
+        struct ptt_beat *b = &ptt_beats[ptt_n_beats++];
+
+        b->pat_x10 = (uint16_t)(pat_ms * 10.0f + 0.5f);
+        b->sbp_x10 = cal.valid ? ptt_apply(cal.sbp_slope_x1000, cal.sbp_icpt_x10, b->pat_x10) : REC_SUM_NA;
+        b->dbp_x10 = cal.valid ? ptt_apply(cal.dbp_slope_x1000, cal.dbp_icpt_x10, b->pat_x10) : REC_SUM_NA;
+    }
+}
+
+uint32_t ptt_get_beats(const struct ptt_beat **beats)
+{
+    *beats = ptt_beats;
+    return ptt_n_beats;
+}
+
+uint16_t ptt_median_pat_x10(void)
+{
+    uint16_t v[PTT_BEATS_MAX];
+    uint32_t n = ptt_n_beats;
+
+    if (n == 0) {
+        return REC_SUM_NA;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint16_t t = ptt_beats[i].pat_x10;
+        uint32_t j = i;
+
+        while (j > 0 && v[j - 1u] > t) {
+            v[j] = v[j - 1u];
+            j--;
+        }
+        v[j] = t;
+    }
+    return (n & 1u) ? v[n / 2u] : (uint16_t)((v[n / 2u - 1u] + v[n / 2u]) / 2u);
+}
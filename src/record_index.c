@@ -0,0 +1,530 @@
+#include "Funciones.h"
+
+#define REC_HDR_CRC_LEN   offsetof(struct rec_hdr, hdr_crc)
+#define REC_SES_CRC_LEN   offsetof(struct rec_session_hdr, hdr_crc)
+#define REC_DIR_CRC_LEN   offsetof(struct rec_dir_entry, hdr_crc)
+#define REC_BANK_CRC_LEN  offsetof(struct rec_dir_hdr, hdr_crc)
+
+BUILD_ASSERT(sizeof(struct rec_summary) == 8);
+BUILD_ASSERT(sizeof(struct rec_hdr) == REC_ENTRY_SIZE);
+BUILD_ASSERT(sizeof(struct rec_session_hdr) == REC_ENTRY_SIZE);
+BUILD_ASSERT(sizeof(struct rec_dir_hdr) == REC_ENTRY_SIZE);
+BUILD_ASSERT(sizeof(struct rec_dir_entry) == REC_ENTRY_SIZE);
+BUILD_ASSERT((MAX_MEASUREMENTS + 1u) * REC_ENTRY_SIZE <= FLASH_IDX_BANK_SIZE);
+BUILD_ASSERT(REC_SESSIONS_MAX < REC_DIR_ENTRIES);
+
+/*
+ * Flash holds several sessions. Each one is a sector-aligned extent from
+ * FLASH_SES_BASE: its own index area (session header plus one rec_hdr per
+ * record), then the record slots. Extents are allocated as a ring after
+ * the newest session, and space is only taken back from sessions that
+ * were downloaded. The directory lists the extents; when its bank fills
+ * up the live entries are copied to the other bank under a new generation.
+ */
+static struct rec_session_info rec_ses[REC_SESSIONS_MAX];
+static uint32_t rec_ses_count;
+static uint32_t rec_ses_next_id = 1;
+static int      rec_sel = -1;
+
+static uint32_t rec_dir_bank = FLASH_DIR_BANK_A;
+static uint32_t rec_dir_gen;
+static uint32_t rec_dir_used;
+static bool     rec_dir_valid;
+
+static struct rec_session_hdr rec_session;
+static uint32_t rec_bank_addr = FLASH_SES_BASE;
+static bool     rec_session_valid;
+
+static struct rec_hdr rec_tab[MAX_MEASUREMENTS];
+static uint32_t rec_valid_mask[(MAX_MEASUREMENTS + 31u) / 32u];
+
+static inline uint32_t rec_entry_addr(uint32_t bank, uint16_t seq)
+{
+    return bank + ((uint32_t)seq + 1u) * REC_ENTRY_SIZE;
+}
+
+static bool rec_session_check(const struct rec_session_hdr *s)
+{
+    return s->magic == REC_SESSION_MAGIC &&
+           s->commit == REC_COMMITTED &&
+           s->num_sequences <= MAX_MEASUREMENTS &&
+           s->hdr_crc == crc32_ieee((const uint8_t *)s, REC_SES_CRC_LEN);
+}
+
+static bool rec_hdr_check(const struct rec_hdr *h, uint16_t seq)
+{
+    return h->magic == REC_MAGIC &&
+           h->commit == REC_COMMITTED &&
+           h->seq == seq &&
+           h->hdr_crc == crc32_ieee((const uint8_t *)h, REC_HDR_CRC_LEN);
+}
+
+static bool rec_bank_check(const struct rec_dir_hdr *b)
+{
+    return b->magic == REC_DIR_BANK_MAGIC &&
+           b->commit == REC_COMMITTED &&
+           b->hdr_crc == crc32_ieee((const uint8_t *)b, REC_BANK_CRC_LEN);
+}
+
+static bool rec_dir_check(const struct rec_dir_entry *e)
+{
+    return e->magic == REC_DIR_MAGIC &&
+           e->commit == REC_COMMITTED &&
+           e->num_sequences <= MAX_MEASUREMENTS &&
+           e->base >= FLASH_SES_BASE &&
+           e->base + e->size <= FLASH_TOTAL_BYTES &&
+           e->hdr_crc == crc32_ieee((const uint8_t *)e, REC_DIR_CRC_LEN);
+}
+
+static void rec_tab_clear(void)
+{
+    memset(rec_tab, 0xFF, sizeof(rec_tab));
+    memset(rec_valid_mask, 0, sizeof(rec_valid_mask));
+}
+
+/* programs one of the erased words after commit */
+static void rec_dir_program(uint16_t slot, size_t off, uint32_t v)
+{
+    flash_write_buffer(rec_entry_addr(rec_dir_bank, slot) + off, (const uint8_t *)&v, sizeof(v));
+}
+
+static void rec_dir_entry_build(const struct rec_session_info *s, struct rec_dir_entry *e)
+{
+    memset(e, 0xFF, sizeof(*e));
+    e->magic         = REC_DIR_MAGIC;
+    e->session_id    = s->id;
+    e->base          = s->base;
+    e->size          = s->size;
+    e->num_sequences = s->num_sequences;
+    e->start_ms      = s->start_ms;
+    e->start_unix    = s->start_unix;
+    e->profile       = s->profile;
+    e->hdr_crc       = crc32_ieee((const uint8_t *)e, REC_DIR_CRC_LEN);
+    e->commit        = REC_COMMITTED;
+}
+
+static void rec_dir_write(uint32_t bank, uint16_t slot, const struct rec_dir_entry *e)
+{
+    uint32_t addr = rec_entry_addr(bank, slot);
+
+    flash_write_buffer(addr, (const uint8_t *)e, offsetof(struct rec_dir_entry, commit));
+    flash_write_buffer(addr + offsetof(struct rec_dir_entry, commit),
+                       (const uint8_t *)&e->commit, sizeof(struct rec_dir_entry) - offsetof(struct rec_dir_entry, commit));
+}
+
+/* copies the live entries to the other bank; the bank header goes last */
+static void rec_dir_compact(void)
+{
+    uint32_t bank = (rec_dir_valid && rec_dir_bank == FLASH_DIR_BANK_A) ? FLASH_DIR_BANK_B
+                                                                        : FLASH_DIR_BANK_A;
+    struct rec_dir_entry e;
+    struct rec_dir_hdr h;
+
+    flash_erase_range(bank, FLASH_IDX_BANK_SIZE);
+
+    for (uint32_t i = 0; i < rec_ses_count; i++) {
+        rec_dir_entry_build(&rec_ses[i], &e);
+        if (!(rec_ses[i].flags & REC_SES_OPEN)) {
+            e.recorded = rec_ses[i].recorded;
+        }
+        if (rec_ses[i].flags & REC_SES_DOWNLOADED) {
+            e.downloaded = REC_COMMITTED;
+        }
+        rec_dir_write(bank, (uint16_t)i, &e);
+        rec_ses[i].dir_slot = (uint16_t)i;
+    }
+
+    memset(&h, 0xFF, sizeof(h));
+    h.magic      = REC_DIR_BANK_MAGIC;
+    h.generation = rec_dir_gen + 1u;
+    h.hdr_crc    = crc32_ieee((const uint8_t *)&h, REC_BANK_CRC_LEN);
+    flash_write_buffer(bank, (const uint8_t *)&h, offsetof(struct rec_dir_hdr, commit));
+
+    uint32_t commit = REC_COMMITTED;
+    flash_write_buffer(bank + offsetof(struct rec_dir_hdr, commit),
+                       (const uint8_t *)&commit, sizeof(commit));
+
+    rec_dir_bank  = bank;
+    rec_dir_gen   = h.generation;
+    rec_dir_used  = rec_ses_count;
+    rec_dir_valid = true;
+}
+
+static void rec_dir_load(void)
+{
+    struct rec_dir_hdr a, b;
+
+    flash_read_bytes(FLASH_DIR_BANK_A, (uint8_t *)&a, sizeof(a));
+    flash_read_bytes(FLASH_DIR_BANK_B, (uint8_t *)&b, sizeof(b));
+
+    bool a_ok = rec_bank_check(&a);
+    bool b_ok = rec_bank_check(&b);
+
+    rec_ses_count = 0;
+    rec_dir_used  = 0;
+    rec_dir_valid = a_ok || b_ok;
+    if (!rec_dir_valid) {
+        rec_dir_gen = 0;
+        return;
+    }
+
+    if (a_ok && (!b_ok || (int32_t)(a.generation - b.generation) > 0)) {
+        rec_dir_bank = FLASH_DIR_BANK_A;
+        rec_dir_gen  = a.generation;
+    } else {
+        rec_dir_bank = FLASH_DIR_BANK_B;
+        rec_dir_gen  = b.generation;
+    }
+
+    for (uint16_t slot = 0; slot < REC_DIR_ENTRIES; slot++) {
+        struct rec_dir_entry e;
+
+        flash_read_bytes(rec_entry_addr(rec_dir_bank, slot), (uint8_t *)&e, sizeof(e));
+        if (e.magic == 0xFFFFFFFFu) {
+            break;
+        }
+        rec_dir_used = slot + 1u;
+        if (!rec_dir_check(&e)) {
+            continue;
+        }
+        rec_ses_next_id = MAX(rec_ses_next_id, e.session_id + 1u);
+        if (e.reclaimed == REC_COMMITTED || rec_ses_count == REC_SESSIONS_MAX) {
+            continue;
+        }
+
+        struct rec_session_info *s = &rec_ses[rec_ses_count++];
+
+        s->id            = e.session_id;
+        s->base          = e.base;
+        s->size          = e.size;
+        s->start_ms      = e.start_ms;
+        s->start_unix    = e.start_unix;
+        s->num_sequences = (uint16_t)e.num_sequences;
+        s->recorded      = (e.recorded == 0xFFFFFFFFu) ? 0 : (uint16_t)e.recorded;
+        s->profile       = e.profile;
+        s->dir_slot      = slot;
+        s->flags         = (e.recorded == 0xFFFFFFFFu ? REC_SES_OPEN : 0) |
+                           (e.downloaded == REC_COMMITTED ? REC_SES_DOWNLOADED : 0);
+    }
+}
+
+static int rec_session_load(int idx)
+{
+    struct rec_session_info *si = &rec_ses[idx];
+
+    if (rec_sel >= 0) {
+        rec_ses[rec_sel].flags &= ~REC_SES_SELECTED;
+    }
+    rec_sel = idx;
+    si->flags |= REC_SES_SELECTED;
+
+    rec_tab_clear();
+    rec_bank_addr = si->base;
+    flash_read_bytes(rec_bank_addr, (uint8_t *)&rec_session, sizeof(rec_session));
+    rec_session_valid = rec_session_check(&rec_session) && rec_session.generation == si->id;
+    if (!rec_session_valid) {
+        return -ENOENT;
+    }
+
+    uint32_t valid = 0;
+    for (uint16_t seq = 0; seq < rec_session.num_sequences; seq++) {
+        struct rec_hdr h;
+
+        flash_read_bytes(rec_entry_addr(rec_bank_addr, seq), (uint8_t *)&h, sizeof(h));
+        if (h.magic == 0xFFFFFFFFu) {
+            continue;
+        }
+        if (!rec_hdr_check(&h, seq)) {
+            continue;
+        }
+        rec_tab[seq] = h;
+        rec_valid_mask[seq / 32u] |= BIT(seq % 32u);
+        valid++;
+    }
+    if (si->flags & REC_SES_OPEN) {
+        si->recorded = (uint16_t)valid;
+    }
+
+    printk("Record index: session %u, %u/%u valid\n",
+           (unsigned int)si->id,
+           (unsigned int)valid,
+           (unsigned int)rec_session.num_sequences);
+    return 0;
+}
+
+static void rec_session_set_downloaded(struct rec_session_info *si)
+{
+    if (si->flags & REC_SES_DOWNLOADED) {
+        return;
+    }
+    rec_dir_program(si->dir_slot, offsetof(struct rec_dir_entry, downloaded), REC_COMMITTED);
+    si->flags |= REC_SES_DOWNLOADED;
+}
+
+/* a closed session without a readable header or records holds nothing to download */
+static bool rec_session_empty(const struct rec_session_info *si)
+{
+    struct rec_session_hdr h;
+
+    if (si->recorded == 0) {
+        return true;
+    }
+    flash_read_bytes(si->base, (uint8_t *)&h, sizeof(h));
+    return !rec_session_check(&h) || h.generation != si->id;
+}
+
+/* programs the record count of the loaded session from rec_valid_mask */
+static void rec_session_close(struct rec_session_info *si)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(rec_valid_mask); i++) {
+        n += popcount(rec_valid_mask[i]);
+    }
+    rec_dir_program(si->dir_slot, offsetof(struct rec_dir_entry, recorded), n);
+    si->recorded = (uint16_t)n;
+    si->flags   &= ~REC_SES_OPEN;
+}
+
+int rec_index_init(void)
+{
+    rec_dir_load();
+    rec_tab_clear();
+    rec_session_valid = false;
+    rec_sel = -1;
+
+    printk("Session directory: gen %u, %u live\n",
+           (unsigned int)rec_dir_gen, (unsigned int)rec_ses_count);
+
+    /*
+     * Nothing can be recording yet, so a session still open was cut short
+     * by a reset or power loss. Close it with what reached flash, or it
+     * could never be downloaded or reclaimed.
+     */
+    for (uint32_t i = 0; i < rec_ses_count; i++) {
+        if (rec_ses[i].flags & REC_SES_OPEN) {
+            (void)rec_session_load((int)i);
+            rec_session_close(&rec_ses[i]);
+            printk("Session %u closed after reset, %u records\n",
+                   (unsigned int)rec_ses[i].id, (unsigned int)rec_ses[i].recorded);
+        }
+        /* otherwise the host can never acknowledge it and the ring stops at its extent */
+        if (!(rec_ses[i].flags & REC_SES_DOWNLOADED) && rec_session_empty(&rec_ses[i])) {
+            rec_session_set_downloaded(&rec_ses[i]);
+            printk("Session %u empty, reclaimable\n", (unsigned int)rec_ses[i].id);
+        }
+    }
+
+    if (rec_ses_count == 0) {
+        memset(&rec_session, 0, sizeof(rec_session));
+        return -ENOENT;
+    }
+    return rec_session_load((int)rec_ses_count - 1);
+}
+
+static void rec_session_reclaim(uint32_t idx)
+{
+    rec_dir_program(rec_ses[idx].dir_slot, offsetof(struct rec_dir_entry, reclaimed), REC_COMMITTED);
+    printk("Session %u reclaimed\n", (unsigned int)rec_ses[idx].id);
+
+    memmove(&rec_ses[idx], &rec_ses[idx + 1u], (rec_ses_count - idx - 1u) * sizeof(rec_ses[0]));
+    rec_ses_count--;
+}
+
+/*
+ * Next extent in ring order. Sessions in the way must have been
+ * downloaded; they are reclaimed oldest first.
+ */
+static int rec_session_alloc(uint32_t size, uint32_t *base)
+{
+    uint32_t addr = rec_ses_count ? rec_ses[rec_ses_count - 1u].base + rec_ses[rec_ses_count - 1u].size
+                                  : FLASH_SES_BASE;
+
+    if (size > FLASH_TOTAL_BYTES - FLASH_SES_BASE) {
+        return -ENOSPC;
+    }
+    if (addr + size > FLASH_TOTAL_BYTES) {
+        addr = FLASH_SES_BASE;
+    }
+
+    uint32_t drop = 0;
+
+    for (uint32_t i = 0; i < rec_ses_count; i++) {
+        bool hit = rec_ses[i].base < addr + size && addr < rec_ses[i].base + rec_ses[i].size;
+
+        if (hit || (i == 0 && rec_ses_count == REC_SESSIONS_MAX)) {
+            if (!(rec_ses[i].flags & REC_SES_DOWNLOADED)) {
+                return -ENOSPC;
+            }
+            drop |= BIT(i);
+        }
+    }
+
+    for (int i = (int)rec_ses_count - 1; i >= 0; i--) {
+        if (drop & BIT(i)) {
+            rec_session_reclaim((uint32_t)i);
+        }
+    }
+    *base = addr;
+    return 0;
+}
+
+int rec_index_begin_session(uint32_t num_sequences, uint32_t start_unix,
+                            const struct capture_profile *prof)
+{
+    if (num_sequences == 0 || num_sequences > MAX_MEASUREMENTS) {
+        return -EINVAL;
+    }
+
+    uint32_t size = REC_SES_EXTENT(num_sequences);
+    uint32_t base;
+
+    if (rec_sel >= 0) {
+        rec_ses[rec_sel].flags &= ~REC_SES_SELECTED;
+    }
+    rec_sel = -1;
+    rec_session_valid = false;
+
+    int ret = rec_session_alloc(size, &base);
+    if (ret) {
+        return ret;
+    }
+
+    if (!rec_dir_valid || rec_dir_used >= REC_DIR_ENTRIES) {
+        rec_dir_compact();
+    }
+
+    struct rec_session_info *si = &rec_ses[rec_ses_count];
+    struct rec_dir_entry e;
+
+    memset(si, 0, sizeof(*si));
+    si->id            = rec_ses_next_id++;
+    si->base          = base;
+    si->size          = size;
+    si->start_ms      = k_uptime_get_32();
+    si->start_unix    = start_unix;
+    si->num_sequences = (uint16_t)num_sequences;
+    si->profile       = *prof;
+    si->dir_slot      = (uint16_t)rec_dir_used;
+    si->flags         = REC_SES_OPEN;
+
+    rec_dir_entry_build(si, &e);
+    rec_dir_write(rec_dir_bank, si->dir_slot, &e);
+    rec_dir_used++;
+    rec_ses_count++;
+
+    struct rec_session_hdr s;
+    memset(&s, 0xFF, sizeof(s));
+    s.magic         = REC_SESSION_MAGIC;
+    s.generation    = si->id;
+    s.num_sequences = num_sequences;
+    s.start_ms      = si->start_ms;
+    s.hdr_crc       = crc32_ieee((const uint8_t *)&s, REC_SES_CRC_LEN);
+
+    flash_erase_range(base, FLASH_IDX_BANK_SIZE);
+    flash_write_buffer(base, (const uint8_t *)&s, offsetof(struct rec_session_hdr, commit));
+
+    uint32_t commit = REC_COMMITTED;
+    flash_write_buffer(base + offsetof(struct rec_session_hdr, commit),
+                       (const uint8_t *)&commit, sizeof(commit));
+
+    s.commit          = REC_COMMITTED;
+    rec_session       = s;
+    rec_bank_addr     = base;
+    rec_session_valid = true;
+    rec_sel           = (int)rec_ses_count - 1;
+    si->flags        |= REC_SES_SELECTED;
+    rec_tab_clear();
+
+    return 0;
+}
+
+int rec_index_end_session(void)
+{
+    if (rec_sel < 0 || !(rec_ses[rec_sel].flags & REC_SES_OPEN)) {
+        return -EINVAL;
+    }
+
+    rec_session_close(&rec_ses[rec_sel]);
+    if (rec_ses[rec_sel].recorded == 0) {
+        rec_session_set_downloaded(&rec_ses[rec_sel]);
+    }
+    return 0;
+}
+
+int rec_index_select(uint32_t session_id)
+{
+    for (uint32_t i = 0; i < rec_ses_count; i++) {
+        if (rec_ses[i].id == session_id) {
+            return rec_session_load((int)i);
+        }
+    }
+    return -ENOENT;
+}
+
+int rec_index_mark_downloaded(void)
+{
+    if (rec_sel < 0 || (rec_ses[rec_sel].flags & REC_SES_OPEN)) {
+        return -EINVAL;
+    }
+    rec_session_set_downloaded(&rec_ses[rec_sel]);
+    return 0;
+}
+
+uint32_t rec_index_num_sessions(void)
+{
+    return rec_ses_count;
+}
+
+const struct rec_session_info *rec_index_session(uint32_t i)
+{
+    return (i < rec_ses_count) ? &rec_ses[i] : NULL;
+}
+
+int rec_index_commit(uint16_t seq, struct rec_hdr *h)
+{
+    if (!rec_session_valid || seq >= rec_session.num_sequences) {
+        return -EINVAL;
+    }
+    if (rec_valid_mask[seq / 32u] & BIT(seq % 32u)) {
+        return -EEXIST;
+    }
+
+    h->magic   = REC_MAGIC;
+    h->seq     = seq;
+    h->hdr_crc = crc32_ieee((const uint8_t *)h, REC_HDR_CRC_LEN);
+
+    uint32_t addr = rec_entry_addr(rec_bank_addr, seq);
+    flash_write_buffer(addr, (const uint8_t *)h, offsetof(struct rec_hdr, commit));
+
+    uint32_t commit = REC_COMMITTED;
+    flash_write_buffer(addr + offsetof(struct rec_hdr, commit),
+                       (const uint8_t *)&commit, sizeof(commit));
+
+    h->commit    = REC_COMMITTED;
+    rec_tab[seq] = *h;
+    rec_valid_mask[seq / 32u] |= BIT(seq % 32u);
+
+    return 0;
+}
+
+const struct rec_hdr *rec_index_lookup(uint16_t seq)
+{
+    if (!rec_session_valid || seq >= rec_session.num_sequences) {
+        return NULL;
+    }
+    if (!(rec_valid_mask[seq / 32u] & BIT(seq % 32u))) {
+        return NULL;
+    }
+    return &rec_tab[seq];
+}
+
+uint32_t rec_index_num_sequences(void)
+{
+    return rec_session_valid ? rec_session.num_sequences : 0u;
+}
+
+uint32_t rec_slot_addr(uint16_t seq)
+{
+    return rec_bank_addr + FLASH_IDX_BANK_SIZE + (uint32_t)seq * SEQ_SLOT_SIZE;
+}
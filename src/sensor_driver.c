@@ -5,17 +5,31 @@
 #include "adi_adpd6000_ppg.h"
 #include "adi_adpd6000_gpio.h"
 #include "adi_adpd6000_ecg.h"
+#include "adi_adpd6000_bioz.h"
 #include "adi_adpd6000_hal.h"
 
+#include <math.h>
+
 #define ADPD_SPI_NODE       DT_NODELABEL(spi1)
 #define ADPD_CS_GPIO_NODE   DT_NODELABEL(gpio0)
 #define ADPD_CS_PIN         17
 
-#define I2C_NODE DT_NODELABEL(i2c0)
-#define TMP117_ADDR 0x48
+#define PPG_AGC_SKIP        25
+#define PPG_AGC_AVG         25
+#define PPG_AGC_CONTINUOUS  0
+
+#define BIOZ_WAVE_AMP       0x200
+
+#define ADPD_SEQ_MAX_BYTES  (PPG_DECIM_MAX * (ECG_SEQ_MAX * 4u + BIOZ_SLOTS * 6u) + PPG_NUM_SLOTS * 12u)
+
+/* FIFO_STATUS: BF_FIFO_BYTE_COUNT, BF_INT_FIFO_OFLOW, BF_INT_FIFO_UFLOW (write 1 to clear) */
+#define ADPD_FIFO_COUNT_MASK    0x07FFu
+#define ADPD_FIFO_OFLOW         BIT(13)
+#define ADPD_FIFO_UFLOW         BIT(14)
+
+#define ADPD_OSC_CAL_SESSION    1
 
 static const struct device *adpd_spi_dev = DEVICE_DT_GET(ADPD_SPI_NODE);
-static const struct device *i2c_dev = DEVICE_DT_GET(I2C_NODE);
 
 static struct spi_config adpd_spi_cfg = {
     .operation = SPI_OP_MODE_MASTER |
@@ -37,10 +51,65 @@ static struct spi_config adpd_spi_cfg = {
 
 static adi_adpd6000_device_t adpd6000_dev;
 static adi_adpd6000_fifo_config_t adpd_fifo_cfg;
+static uint16_t adpd_seq_bytes;
+static uint16_t adpd_fifo_left;
+static int64_t  adpd_drain_ticks;
+static uint8_t  adpd_decim = 1;
 
-static int32_t ppg1_buf[VEC_LEN];
-static int32_t ppg2_buf[VEC_LEN];
+static int32_t ppg_buf[PPG_NUM_SLOTS][VEC_LEN];
 static float   template_temp_val = 0.0f;
+static struct temp_result template_temp;
+static struct fifo_health adpd_fifo_health;
+static struct fifo_health template_fifo;
+static struct rec_timebase template_timebase;
+static struct rec_burst template_burst;
+static struct rec_wake template_wake;
+static uint32_t template_ts_ms;
+static struct rec_summary template_summary;
+static uint16_t template_sbp_x10 = REC_SUM_NA;
+static uint16_t template_dbp_x10 = REC_SUM_NA;
+static uint32_t ppg_full_scale[2];
+static uint32_t template_amb[PPG_NUM_SLOTS];
+static uint16_t template_noise[2];
+
+static int32_t  ecg_buf[ECG_LEN];
+static uint32_t ecg_len;
+static uint8_t  ecg_status;
+static uint16_t template_bioz_rr_x10 = REC_SUM_NA;
+
+/*
+ * Capture profile: written from the BLE RX path, latched at the start of
+ * each measurement and reapplied to the AFE only when rate or slot count
+ * change. Channel buffers are the first win_len samples of ppg_buf.
+ */
+static struct capture_profile capture_profile = {
+    .fs_hz     = PPG_FS_HZ,
+    .win_len   = VEC_LEN,
+    .warmup_ms = PPG_WARMUP_MS,
+    .channels  = PPG_NUM_SLOTS,
+    .decim     = 1,
+};
+static struct capture_profile capture_profile_hw;
+static struct capture_profile template_profile;
+static struct k_spinlock capture_profile_lock;
+
+static adi_adpd6000_ppg_agc_cfg_t ppg_agc_cfg = {
+    .ppg_skip_sample_number    = PPG_AGC_SKIP,
+    .ppg_average_sample_number = PPG_AGC_AVG,
+    .power_first_en            = 1,
+};
+
+/* LED/TIA after the previous AGC pass, for the firmware convergence check */
+static struct {
+    uint8_t led[PPG_NUM_SLOTS];
+    uint8_t tia[PPG_NUM_SLOTS];
+} ppg_agc_prev;
+
+static struct {
+    bool    valid;
+    uint8_t led[PPG_NUM_SLOTS];
+    uint8_t tia[PPG_NUM_SLOTS];
+} ppg_agc_cache;
 
 static int32_t adpd6000_spi_write(void *user_data, uint8_t *wr_buf, uint32_t len)
 {
@@ -126,344 +195,614 @@ static bool adpd6000_verify_connected(void)
     }
 }
 
-int adpd6000_init_config(void)
+static int adpd6000_ecg_config(void)
 {
     int32_t err;
 
-    if (!device_is_ready(adpd_spi_dev)) {
-        return -ENODEV;
-    }
+    err = adi_adpd6000_ecg_set_odr(&adpd6000_dev, API_ADPD6000_ECG_ODR_250);
+    if (adpd_check_error(err, "ecg_set_odr")) return err;
+    k_msleep(50);
 
-    memset(&adpd6000_dev, 0, sizeof(adpd6000_dev));
-    adpd6000_dev.user_data = NULL;
-    adpd6000_dev.write     = adpd6000_spi_write;
-    adpd6000_dev.read      = adpd6000_spi_read;
-    adpd6000_dev.log_write = adpd6000_log_write;
+    err = adi_adpd6000_ecg_set_oversample(&adpd6000_dev, ECG_OVERSAMPLE);
+    if (adpd_check_error(err, "ecg_set_oversample")) return err;
+    k_msleep(50);
 
-    err = adi_adpd6000_device_sw_reset(&adpd6000_dev);
-    if (adpd_check_error(err, "device_sw_reset")) return err;
-    k_msleep(100);
+    err = adi_adpd6000_ecg_set_input_mux(&adpd6000_dev, true, false);
+    if (adpd_check_error(err, "ecg_set_input_mux")) return err;
+    k_msleep(50);
 
-    if (!adpd6000_verify_connected()) {
-        return -ENODEV;
-    }
+    err = adi_adpd6000_ecg_set_rld(&adpd6000_dev, true, API_ADPD6000_ECG_RLD_OUTPUT_CM_INPUT);
+    if (adpd_check_error(err, "ecg_set_rld")) return err;
+    k_msleep(50);
 
-    err = adi_adpd6000_device_init(&adpd6000_dev);
-    if (adpd_check_error(err, "device_init")) return err;
-    k_msleep(100);
+    err = adi_adpd6000_ecg_leadoff_set_dc(&adpd6000_dev, true,
+                                          API_ADPD6000_ECG_DC_LEADOFF_6NA,
+                                          API_ADPD6000_ECG_DC_LEADOFF_200MV,
+                                          API_ADPD6000_ECG_DC_LEADOFF_CURRENT_SINK,
+                                          API_ADPD6000_ECG_DC_LEADOFF_CURRENT_SOURCE);
+    if (adpd_check_error(err, "ecg_leadoff_set_dc")) return err;
+    k_msleep(50);
 
+    err = adi_adpd6000_ecg_enable_statusbyte(&adpd6000_dev, true);
+    if (adpd_check_error(err, "ecg_enable_statusbyte")) return err;
+    k_msleep(50);
 
-    err = adi_adpd6000_device_enable_internal_osc_960k(&adpd6000_dev);
-    if (adpd_check_error(err, "enable_internal_osc_960k")) return err;
-    k_msleep(100);
+    err = adi_adpd6000_ecg_enable_slot(&adpd6000_dev, true);
+    if (adpd_check_error(err, "ecg_enable_slot")) return err;
+    k_msleep(50);
 
+    return 0;
+}
 
-    {
-        uint32_t sys_clk = 960000;
-        uint32_t freq    = 125;
-        err = adi_adpd6000_device_set_slot_freq(&adpd6000_dev, sys_clk, freq);
-        if (adpd_check_error(err, "device_set_slot_freq")) return err;
-        k_msleep(100);
+/*
+ * Four-wire BioZ in the SDK's ms4 order: internal Rcal voltage, body
+ * voltage, internal Rcal current, body current. Each slot runs one 512-point
+ * DFT at BIOZ_FREQ_HZ and pushes a real/imag pair into the FIFO sequence.
+ */
+static int adpd6000_bioz_config(void)
+{
+    static const adi_adpd6000_bioz_slot_connect_e conn[BIOZ_SLOTS] = {
+        API_ADPD6000_BIOZ_CONN_INT_RCAL_VOL,
+        API_ADPD6000_BIOZ_CONN_BIO_IMP_VOL,
+        API_ADPD6000_BIOZ_CONN_INT_RCAL_CUR,
+        API_ADPD6000_BIOZ_CONN_BIO_IMP_CUR,
+    };
+    float rcal;
+    int32_t err;
+
+    err = adi_adpd6000_bioz_set_slot_mode(&adpd6000_dev, API_ADPD6000_BIOZ_SLOT_ABCD);
+    if (adpd_check_error(err, "bioz_set_slot_mode")) return err;
+    k_msleep(50);
+
+    for (uint8_t slot = 0; slot < BIOZ_SLOTS; slot++) {
+        err = adi_adpd6000_bioz_cfg_wave(&adpd6000_dev, slot, BIOZ_WAVE_AMP, BIOZ_FREQ_HZ, 0, 0);
+        if (adpd_check_error(err, "bioz_cfg_wave")) return err;
+
+        err = adi_adpd6000_bioz_tia_set_gain(&adpd6000_dev, slot, API_ADPD6000_BIOZ_TIA_GAIN_4K, 0);
+        if (adpd_check_error(err, "bioz_tia_set_gain")) return err;
+
+        err = adi_adpd6000_bioz_dft_set_point_number(&adpd6000_dev, slot, API_ADPD6000_BIOZ_DFT_POINT_512);
+        if (adpd_check_error(err, "bioz_dft_set_point_number")) return err;
+
+        err = adi_adpd6000_bioz_dft_enable_hanning(&adpd6000_dev, slot, true);
+        if (adpd_check_error(err, "bioz_dft_enable_hanning")) return err;
+
+        err = adi_adpd6000_bioz_enable_dac_ref(&adpd6000_dev, slot, true);
+        if (adpd_check_error(err, "bioz_enable_dac_ref")) return err;
+
+        err = adi_adpd6000_bioz_enable_tia(&adpd6000_dev, slot, true);
+        if (adpd_check_error(err, "bioz_enable_tia")) return err;
+
+        err = adi_adpd6000_bioz_enable_exbuf(&adpd6000_dev, slot, true);
+        if (adpd_check_error(err, "bioz_enable_exbuf")) return err;
+
+        err = adi_adpd6000_bioz_enable_pga(&adpd6000_dev, slot, true);
+        if (adpd_check_error(err, "bioz_enable_pga")) return err;
+
+        err = adi_adpd6000_bioz_set_slot_connection(&adpd6000_dev, slot, conn[slot]);
+        if (adpd_check_error(err, "bioz_set_slot_connection")) return err;
+        k_msleep(50);
     }
 
-    err = adi_adpd6000_ppg_set_slot_mode(&adpd6000_dev, API_ADPD6000_PPG_SLOT_AB);
-    if (adpd_check_error(err, "ppg_set_slot_mode")) return err;
+    err = adi_adpd6000_bioz_get_internal_rcal(&adpd6000_dev, &rcal);
+    if (adpd_check_error(err, "bioz_get_internal_rcal")) return err;
+    bioz_set_rcal(rcal);
     k_msleep(50);
 
-    uint8_t slot_A   = 0;
-    uint8_t slot_B   = 1;
+    return 0;
+}
+
+/*
+ * Per-slot PPG settings. Slot order is FIFO order and channel order in the
+ * record: red and IR are always slots A and B, extra wavelengths follow.
+ */
+struct ppg_slot_desc {
+    uint8_t  pair;
+    uint8_t  led_idx;
+    adi_adpd6000_ppg_led_channel_e led;
+    uint8_t  led_current;
+    uint8_t  led_width;
+    uint8_t  led_offset;
+    uint16_t num_int;
+    uint16_t num_repeat;
+    uint16_t min_period;
+    uint8_t  dc_current;
+    adi_adpd6000_ppg_sample_type_e sample_type;
+};
+
+/* two-region digital integration removes ambient in the AFE; dark is kept for the header means */
+static const struct ppg_slot_desc ppg_slots[PPG_NUM_SLOTS] = {
+    [PPG_CH_RED] = {
+        .pair = 0, .led_idx = 0, .led = API_ADPD6000_PPG_LED_A, .led_current = 50,
+        .led_width = 24, .led_offset = 59, .num_int = 9, .num_repeat = 26,
+        .min_period = 60, .dc_current = 0,
+        .sample_type = API_ADPD6000_PPG_SAMPLE_TYPE_TWO_REGION,
+    },
+    [PPG_CH_IR] = {
+        .pair = 1, .led_idx = 0, .led = API_ADPD6000_PPG_LED_B, .led_current = 53,
+        .led_width = 36, .led_offset = 63, .num_int = 13, .num_repeat = 20,
+        .min_period = 138, .dc_current = 15,
+        .sample_type = API_ADPD6000_PPG_SAMPLE_TYPE_TWO_REGION,
+    },
+#if PPG_GREEN_ENABLE
+    [PPG_CH_GREEN] = {
+        .pair = 0, .led_idx = 1, .led = API_ADPD6000_PPG_LED_A, .led_current = 40,
+        .led_width = 24, .led_offset = 59, .num_int = 9, .num_repeat = 26,
+        .min_period = 60, .dc_current = 0,
+        .sample_type = API_ADPD6000_PPG_SAMPLE_TYPE_TWO_REGION,
+    },
+#endif
+};
+
+static int adpd6000_ppg_slot_config(uint8_t slot, const struct ppg_slot_desc *d)
+{
     uint8_t channel_1 = 0;
     uint8_t channel_2 = 1;
-    uint8_t pair_12  = 0;
-    uint8_t pair_34  = 1;
-    uint8_t vc_index = 0;
+    uint8_t vc_index  = 0;
+    int32_t err;
 
-    err = adi_adpd6000_ppg_tia_set_input_res(&adpd6000_dev, slot_A, API_ADPD6000_PPG_TIA_INPUT_RES_6K5);
-    if (adpd_check_error(err, "ppg_tia_set_input_res A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_tia_set_input_res(&adpd6000_dev, slot, API_ADPD6000_PPG_TIA_INPUT_RES_6K5);
+    if (adpd_check_error(err, "ppg_tia_set_input_res")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_input_res(&adpd6000_dev, slot_B, API_ADPD6000_PPG_TIA_INPUT_RES_6K5);
-    if (adpd_check_error(err, "ppg_tia_set_input_res B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_tia_set_gain_res(&adpd6000_dev, slot, channel_1, API_ADPD6000_PPG_TIA_GAIN_RES_25K);
+    if (adpd_check_error(err, "ppg_tia_set_gain_res")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_gain_res(&adpd6000_dev, slot_A, channel_1, API_ADPD6000_PPG_TIA_GAIN_RES_25K);
-    if (adpd_check_error(err, "ppg_tia_set_gain_res A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_tia_set_vref_value(&adpd6000_dev, slot, API_ADPD6000_PPG_TIA_VREF_1P265);
+    if (adpd_check_error(err, "ppg_tia_set_vref_value")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_gain_res(&adpd6000_dev, slot_B, channel_1, API_ADPD6000_PPG_TIA_GAIN_RES_25K);
-    if (adpd_check_error(err, "ppg_tia_set_gain_res B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_tia_set_vref_pulse_alt_value(&adpd6000_dev, slot, API_ADPD6000_PPG_TIA_VREF_0P8855);
+    if (adpd_check_error(err, "ppg_tia_set_vref_pulse_alt_value")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_vref_value(&adpd6000_dev, slot_A, API_ADPD6000_PPG_TIA_VREF_1P265);
-    if (adpd_check_error(err, "ppg_tia_set_vref_value A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_tia_enable_vref_pulse(&adpd6000_dev, slot, true);
+    if (adpd_check_error(err, "ppg_tia_enable_vref_pulse")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_vref_value(&adpd6000_dev, slot_B, API_ADPD6000_PPG_TIA_VREF_1P265);
-    if (adpd_check_error(err, "ppg_tia_set_vref_value B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_set_input_mux(&adpd6000_dev, slot, d->pair, API_ADPD6000_PPG_INPUT_B1);
+    if (adpd_check_error(err, "ppg_set_input_mux")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_vref_pulse_alt_value(&adpd6000_dev, slot_A, API_ADPD6000_PPG_TIA_VREF_0P8855);
-    if (adpd_check_error(err, "ppg_tia_set_vref_pulse_alt_value A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_enable_amp(&adpd6000_dev, slot, channel_1, false);
+    if (adpd_check_error(err, "ppg_enable_amp")) return err;
 
-    err = adi_adpd6000_ppg_tia_set_vref_pulse_alt_value(&adpd6000_dev, slot_B, API_ADPD6000_PPG_TIA_VREF_0P8855);
-    if (adpd_check_error(err, "ppg_tia_set_vref_pulse_alt_value B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_integ_set_gain(&adpd6000_dev, slot, channel_1, API_ADPD6000_PPG_INTEG_50K_GAIN_2);
+    if (adpd_check_error(err, "ppg_integ_set_gain")) return err;
 
-    err = adi_adpd6000_ppg_tia_enable_vref_pulse(&adpd6000_dev, slot_A, true);
-    if (adpd_check_error(err, "ppg_tia_enable_vref_pulse A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot, channel_1, API_ADPD6000_PPG_INTEG_CAP_12P6);
+    if (adpd_check_error(err, "ppg_integ_select_cap ch1")) return err;
 
-    err = adi_adpd6000_ppg_tia_enable_vref_pulse(&adpd6000_dev, slot_B, true);
-    if (adpd_check_error(err, "ppg_tia_enable_vref_pulse B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot, channel_2, API_ADPD6000_PPG_INTEG_CAP_12P6);
+    if (adpd_check_error(err, "ppg_integ_select_cap ch2")) return err;
 
-    err = adi_adpd6000_ppg_enable_input_diff_mode(&adpd6000_dev, pair_12, false);
-    if (adpd_check_error(err, "ppg_enable_input_diff_mode pair_12")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_integ_set_width(&adpd6000_dev, slot, 3);
+    if (adpd_check_error(err, "ppg_integ_set_width")) return err;
 
-    err = adi_adpd6000_ppg_enable_input_diff_mode(&adpd6000_dev, pair_34, false);
-    if (adpd_check_error(err, "ppg_enable_input_diff_mode pair_34")) return err;
+    err = adi_adpd6000_ppg_integ_enable_single_clk(&adpd6000_dev, slot, true);
+    if (adpd_check_error(err, "ppg_integ_enable_single_clk")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_set_input_mux(&adpd6000_dev, slot_A, pair_12, API_ADPD6000_PPG_INPUT_B1);
-    if (adpd_check_error(err, "ppg_set_input_mux A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_current(&adpd6000_dev, slot, d->led_idx, d->led_current);
+    if (adpd_check_error(err, "ppg_led_set_current")) return err;
 
-    err = adi_adpd6000_ppg_set_input_mux(&adpd6000_dev, slot_B, pair_34, API_ADPD6000_PPG_INPUT_B1);
-    if (adpd_check_error(err, "ppg_set_input_mux B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_channel(&adpd6000_dev, slot, d->led_idx, d->led);
+    if (adpd_check_error(err, "ppg_led_set_channel")) return err;
 
-    err = adi_adpd6000_ppg_set_sleep_input_mux(&adpd6000_dev, pair_12, API_ADPD6000_PPG_INPUT_SLEEP_BOTH_CATH1);
-    if (adpd_check_error(err, "ppg_set_sleep_input_mux pair_12")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_mode(&adpd6000_dev, slot, d->led_idx, API_ADPD6000_PPG_LED_HIGH_SNR);
+    if (adpd_check_error(err, "ppg_led_set_mode")) return err;
 
-    err = adi_adpd6000_ppg_set_sleep_input_mux(&adpd6000_dev, pair_34, API_ADPD6000_PPG_INPUT_SLEEP_BOTH_CATH1);
-    if (adpd_check_error(err, "ppg_set_sleep_input_mux pair_34")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_width(&adpd6000_dev, slot, d->led_width);
+    if (adpd_check_error(err, "ppg_led_set_width")) return err;
 
-    err = adi_adpd6000_ppg_set_cathode(&adpd6000_dev,
-                                       API_ADPD6000_PPG_CATH_VDD,
-                                       API_ADPD6000_PPG_CATH_VDD);
-    if (adpd_check_error(err, "ppg_set_cathode")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_offset(&adpd6000_dev, slot, d->led_offset, 0x13);
+    if (adpd_check_error(err, "ppg_led_set_offset")) return err;
 
-    err = adi_adpd6000_ppg_enable_amp(&adpd6000_dev, slot_A, channel_1, false);
-    if (adpd_check_error(err, "ppg_enable_amp A")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_led_set_count(&adpd6000_dev, slot, d->num_int, d->num_repeat);
+    if (adpd_check_error(err, "ppg_led_set_count")) return err;
 
-    err = adi_adpd6000_ppg_enable_amp(&adpd6000_dev, slot_B, channel_1, false);
-    if (adpd_check_error(err, "ppg_enable_amp B")) return err;
+    err = adi_adpd6000_ppg_set_minperiod(&adpd6000_dev, slot, d->min_period);
+    if (adpd_check_error(err, "ppg_set_minperiod")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_integ_set_gain(&adpd6000_dev, slot_A, channel_1, API_ADPD6000_PPG_INTEG_50K_GAIN_2);
-    if (adpd_check_error(err, "ppg_integ_set_gain A ch1")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_sel_precon(&adpd6000_dev, slot, API_ADPD6000_PPG_PRECON_AFE_VREF);
+    if (adpd_check_error(err, "ppg_sel_precon")) return err;
 
-    err = adi_adpd6000_ppg_integ_set_gain(&adpd6000_dev, slot_B, channel_1, API_ADPD6000_PPG_INTEG_50K_GAIN_2);
-    if (adpd_check_error(err, "ppg_integ_set_gain B ch1")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_sel_afe_path(&adpd6000_dev, slot, API_ADPD6000_PPG_AFE_PATH_TIA_BUF_ADC_1X);
+    if (adpd_check_error(err, "ppg_sel_afe_path")) return err;
 
-    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot_A, channel_1, API_ADPD6000_PPG_INTEG_CAP_12P6);
-    if (adpd_check_error(err, "ppg_integ_select_cap A ch1")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_config_vc(&adpd6000_dev, slot, vc_index,
+                                     API_ADPD6000_PPG_VC_DELTA,
+                                     API_ADPD6000_PPG_VC_VDD,
+                                     API_ADPD6000_PPG_VC_PULSE_NO);
+    if (adpd_check_error(err, "ppg_config_vc")) return err;
 
-    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot_B, channel_1, API_ADPD6000_PPG_INTEG_CAP_12P6);
-    if (adpd_check_error(err, "ppg_integ_select_cap B ch1")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_set_dcdac(&adpd6000_dev, slot, channel_1, d->dc_current);
+    if (adpd_check_error(err, "ppg_set_dcdac")) return err;
 
-    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot_A, channel_2, API_ADPD6000_PPG_INTEG_CAP_12P6);
-    if (adpd_check_error(err, "ppg_integ_select_cap A ch2")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_ppg_set_data_size(&adpd6000_dev, slot, 4, PPG_LIT_ENABLE ? 4 : 0, 4);
+    if (adpd_check_error(err, "ppg_set_data_size")) return err;
+
+    err = adi_adpd6000_ppg_set_window_offset(&adpd6000_dev, slot, 0, 0, 0);
+    if (adpd_check_error(err, "ppg_set_window_offset")) return err;
 
-    err = adi_adpd6000_ppg_integ_select_cap(&adpd6000_dev, slot_B, channel_2, API_ADPD6000_PPG_INTEG_CAP_12P6);
-    if (adpd_check_error(err, "ppg_integ_select_cap B ch2")) return err;
+    err = adi_adpd6000_ppg_set_alctype(&adpd6000_dev, slot, API_ADPD6000_PPG_ALC_COARSE_FINE);
+    if (adpd_check_error(err, "ppg_set_alctype")) return err;
+
+    err = adi_adpd6000_ppg_set_sample_type(&adpd6000_dev, slot, d->sample_type);
+    if (adpd_check_error(err, "ppg_set_sample_type")) return err;
     k_msleep(50);
 
-    {
-        uint8_t width_integ = 3;
-        err = adi_adpd6000_ppg_integ_set_width(&adpd6000_dev, slot_A, width_integ);
-        if (adpd_check_error(err, "ppg_integ_set_width A")) return err;
-        k_msleep(50);
+    ppg_agc_cfg.slot[slot] = (adi_adpd6000_ppg_agc_slot_t){
+        .agc_en = 1, .led_chnl = d->led_idx, .led_ab = d->led, .tia_chnl = 0,
+        .agc_type = !PPG_AGC_CONTINUOUS,
+    };
+    return 0;
+}
 
-        err = adi_adpd6000_ppg_integ_set_width(&adpd6000_dev, slot_B, width_integ);
-        if (adpd_check_error(err, "ppg_integ_set_width B")) return err;
-        k_msleep(50);
+#ifdef CONFIG_BOARD_NATIVE_SIM
+/*
+ * float ms4/ms6 against the SDK's double implementation on random 24-bit
+ * DFT words. Limits are ~2-3x the worst case over 1M vectors of this
+ * generator: ms4 3.2e-7 / 7.6e-5 deg; ms6 1.0e-4 / 5.3e-3 deg, the ms6 tail
+ * coming from near-singular random inputs.
+ */
+#define BIOZ_SELFTEST_N         10000u
+#define BIOZ_MS4_TOL_REL        1e-6f
+#define BIOZ_MS4_TOL_DEG        2e-4f
+#define BIOZ_MS6_TOL_REL        2.5e-4f
+#define BIOZ_MS6_TOL_DEG        1.5e-2f
+
+/* atan(y/x) phases are only defined modulo 180 deg */
+static float bioz_phase_err(float p, float ref)
+{
+    float d = fabsf(p - ref);
+
+    while (d > 90.0f) {
+        d = fabsf(d - 180.0f);
     }
+    return d;
+}
 
-    err = adi_adpd6000_ppg_integ_enable_single_clk(&adpd6000_dev, slot_A, true);
-    if (adpd_check_error(err, "ppg_integ_enable_single_clk A")) return err;
+static int adpd6000_bioz_selftest(void)
+{
+    uint32_t x = 0x2545F491u;
+    uint32_t r_raw[6], i_raw[6];
+    float fr[6], fi[6], rcal, a_ref, p_ref, a, p;
+    float e4a = 0.0f, e4p = 0.0f, e6a = 0.0f, e6p = 0.0f;
+
+    (void)adi_adpd6000_bioz_get_rcal(&rcal);
+
+    for (uint32_t n = 0; n < BIOZ_SELFTEST_N; n++) {
+        for (int i = 0; i < 6; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            r_raw[i] = x & 0xFFFFFFu;
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            i_raw[i] = x & 0xFFFFFFu;
+            fr[i] = (float)((int32_t)(r_raw[i] << 8) >> 8);
+            fi[i] = (float)((int32_t)(i_raw[i] << 8) >> 8);
+        }
+
+        (void)adi_adpd6000_bioz_cal_ms4(r_raw, i_raw, &a_ref, &p_ref);
+        bioz_ms4_f(fr, fi, rcal, &a, &p);
+        e4a = MAX(e4a, fabsf(a - a_ref) / a_ref);
+        e4p = MAX(e4p, bioz_phase_err(p, p_ref));
+
+        (void)adi_adpd6000_bioz_cal_ms6(r_raw, i_raw, &a_ref, &p_ref);
+        bioz_ms6_f(fr, fi, rcal, &a, &p);
+        e6a = MAX(e6a, fabsf(a - a_ref) / a_ref);
+        e6p = MAX(e6p, bioz_phase_err(p, p_ref));
+    }
+
+    /* a NaN propagates through MAX() and fails the compare */
+    bool pass = e4a <= BIOZ_MS4_TOL_REL && e4p <= BIOZ_MS4_TOL_DEG &&
+                e6a <= BIOZ_MS6_TOL_REL && e6p <= BIOZ_MS6_TOL_DEG;
+
+    printk("BioZ self-test %s: ms4 %d ppb %d udeg, ms6 %d ppb %d udeg\n",
+           pass ? "pass" : "FAIL",
+           (int)(e4a * 1e9f), (int)(e4p * 1e6f), (int)(e6a * 1e9f), (int)(e6p * 1e6f));
+    return pass ? 0 : -EIO;
+}
+#endif
+
+/*
+ * With ECG on, the frame rate must divide ECG_FS_HZ: the ECG oversample is
+ * an integer per frame, and QRS/PTT assume exactly ECG_FS_HZ.
+ */
+static bool ecg_frame_ok(uint32_t frame_hz)
+{
+    return !ECG_MODE_ENABLE || (ECG_FS_HZ % frame_hz) == 0;
+}
+
+/*
+ * Slot rate, active PPG slots and ECG oversampling (one ECG sample per
+ * ECG_FS_HZ tick within each frame), then re-reads the FIFO layout.
+ *
+ * With decim > 1 the AFE frames at fs_hz * decim and each PPG slot's
+ * decimator sums decim samples before the FIFO (SUBSAMPLE off: the slot
+ * still fires every frame). ECG and BioZ are not decimated, so one PPG
+ * sample is preceded by decim frames of ECG/BioZ; the SDK's sequence_size
+ * describes a single frame.
+ */
+static int adpd6000_apply_profile(const struct capture_profile *p)
+{
+    uint32_t frame_hz = (uint32_t)p->fs_hz * p->decim;
+    int32_t err;
+
+    if (!ecg_frame_ok(frame_hz)) {
+        return -EINVAL;
+    }
+
+    err = adi_adpd6000_device_set_slot_freq(&adpd6000_dev, 960000, frame_hz);
+    if (adpd_check_error(err, "device_set_slot_freq")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_integ_enable_single_clk(&adpd6000_dev, slot_B, true);
-    if (adpd_check_error(err, "ppg_integ_enable_single_clk B")) return err;
+    err = adi_adpd6000_ppg_set_slot_mode(&adpd6000_dev, (adi_adpd6000_ppg_slot_mode_e)p->channels);
+    if (adpd_check_error(err, "ppg_set_slot_mode")) return err;
     k_msleep(50);
 
-    {
-        uint8_t  led_idx_1A     = 0;
-        uint8_t  current        = 50;
-        uint8_t  led_width      = 24;
-        uint8_t  led_offset     = 59;
-        uint8_t  sec_led_offset = 0x13;
-        uint16_t num_int        = 9;
-        uint16_t num_repeat     = 26;
-        uint16_t min_period     = 60;
-
-        err = adi_adpd6000_ppg_led_set_current(&adpd6000_dev, slot_A, led_idx_1A, current);
-        if (adpd_check_error(err, "ppg_led_set_current A")) return err;
-        k_msleep(50);
+    for (uint8_t slot = 0; slot < p->channels; slot++) {
+        err = adi_adpd6000_ppg_set_decimate(&adpd6000_dev, slot, false, p->decim - 1u);
+        if (adpd_check_error(err, "ppg_set_decimate")) return err;
+    }
+    k_msleep(50);
 
-        err = adi_adpd6000_ppg_led_set_channel(&adpd6000_dev, slot_A, led_idx_1A, API_ADPD6000_PPG_LED_A);
-        if (adpd_check_error(err, "ppg_led_set_channel A")) return err;
+    if (ECG_MODE_ENABLE) {
+        err = adi_adpd6000_ecg_set_oversample(&adpd6000_dev, ECG_FS_HZ / frame_hz);
+        if (adpd_check_error(err, "ecg_set_oversample")) return err;
         k_msleep(50);
+    }
 
-        err = adi_adpd6000_ppg_led_set_mode(&adpd6000_dev, slot_A, led_idx_1A, API_ADPD6000_PPG_LED_HIGH_SNR);
-        if (adpd_check_error(err, "ppg_led_set_mode A")) return err;
-        k_msleep(50);
+    err = adi_adpd6000_device_get_sequence_fifo_config(&adpd6000_dev, &adpd_fifo_cfg);
+    if (adpd_check_error(err, "device_get_sequence_fifo_config")) return err;
+    if (adpd_fifo_cfg.ecg_slot && adpd_fifo_cfg.ecg_over_sample > ECG_SEQ_MAX) return -EINVAL;
+    if (adpd_fifo_cfg.bioz_slot > BIOZ_SLOTS) return -EINVAL;
+    if (adpd_fifo_cfg.ppg_slot != p->channels || adpd_fifo_cfg.ppg_chnl_num != p->channels) return -EINVAL;
 
-        err = adi_adpd6000_ppg_led_set_width(&adpd6000_dev, slot_A, led_width);
-        if (adpd_check_error(err, "ppg_led_set_width A")) return err;
-        k_msleep(50);
+    uint32_t frame = adpd_fifo_cfg.ecg_slot * adpd_fifo_cfg.ecg_over_sample * adpd_fifo_cfg.ecg_size +
+                     6u * adpd_fifo_cfg.bioz_slot;
+    uint32_t bytes = (adpd_fifo_cfg.sequence_size - frame) + frame * p->decim;
 
-        err = adi_adpd6000_ppg_led_set_offset(&adpd6000_dev, slot_A, led_offset, sec_led_offset);
-        if (adpd_check_error(err, "ppg_led_set_offset A")) return err;
-        k_msleep(50);
+    if (bytes > ADPD_SEQ_MAX_BYTES) return -EINVAL;
+    adpd_seq_bytes = (uint16_t)bytes;
+    adpd_decim     = p->decim;
 
-        err = adi_adpd6000_ppg_led_set_count(&adpd6000_dev, slot_A, num_int, num_repeat);
-        if (adpd_check_error(err, "ppg_led_set_count A")) return err;
-        k_msleep(50);
+    capture_profile_hw = *p;
+    return 0;
+}
 
-        err = adi_adpd6000_ppg_set_minperiod(&adpd6000_dev, slot_A, min_period);
-        if (adpd_check_error(err, "ppg_set_minperiod A")) return err;
-        k_msleep(50);
+int measure_set_profile(const struct capture_profile *p)
+{
+    if (p->fs_hz < PPG_FS_MIN_HZ || p->fs_hz > PPG_FS_MAX_HZ ||
+        p->win_len < PPG_WIN_MIN || p->win_len > VEC_LEN ||
+        p->channels < 2u || p->channels > PPG_NUM_SLOTS ||
+        p->decim < 1u || p->decim > PPG_DECIM_MAX ||
+        (uint32_t)p->fs_hz * p->decim > PPG_FS_MAX_HZ ||
+        !ecg_frame_ok((uint32_t)p->fs_hz * p->decim) ||
+        p->warmup_ms > PPG_WARMUP_MAX_MS) {
+        return -EINVAL;
     }
 
-    {
-        uint8_t  led_idx_1x       = 0;
-        uint8_t  current_B        = 53;
-        uint8_t  led_width_B      = 36;
-        uint8_t  led_offset_B     = 63;
-        uint8_t  sec_led_offset_B = 0x13;
-        uint16_t num_int_B        = 13;
-        uint16_t num_repeat_B     = 20;
-        uint16_t min_period_B     = 138;
-
-        err = adi_adpd6000_ppg_led_set_current(&adpd6000_dev, slot_B, led_idx_1x, current_B);
-        if (adpd_check_error(err, "ppg_led_set_current B")) return err;
-        k_msleep(50);
+    k_spinlock_key_t key = k_spin_lock(&capture_profile_lock);
 
-        err = adi_adpd6000_ppg_led_set_channel(&adpd6000_dev, slot_B, led_idx_1x, API_ADPD6000_PPG_LED_B);
-        if (adpd_check_error(err, "ppg_led_set_channel B")) return err;
-        k_msleep(50);
+    capture_profile = *p;
+    k_spin_unlock(&capture_profile_lock, key);
+    return 0;
+}
 
-        err = adi_adpd6000_ppg_led_set_mode(&adpd6000_dev, slot_B, led_idx_1x, API_ADPD6000_PPG_LED_HIGH_SNR);
-        if (adpd_check_error(err, "ppg_led_set_mode B")) return err;
-        k_msleep(50);
+void measure_get_profile(struct capture_profile *p)
+{
+    k_spinlock_key_t key = k_spin_lock(&capture_profile_lock);
 
-        err = adi_adpd6000_ppg_led_set_width(&adpd6000_dev, slot_B, led_width_B);
-        if (adpd_check_error(err, "ppg_led_set_width B")) return err;
-        k_msleep(50);
+    *p = capture_profile;
+    k_spin_unlock(&capture_profile_lock, key);
+}
 
-        err = adi_adpd6000_ppg_led_set_offset(&adpd6000_dev, slot_B, led_offset_B, sec_led_offset_B);
-        if (adpd_check_error(err, "ppg_set_led_offset B")) return err;
-        k_msleep(50);
+/*
+ * AFE power state. Between measurements the AFE is parked with GO_SLEEP set
+ * and the 960 kHz oscillator off; registers survive sleep, so waking only
+ * restarts the clock. The configuration registers are cached on the way
+ * down and compared on the way up, and any that changed are written back,
+ * which covers a supply dip or a lost write without a full re-init.
+ */
+enum adpd_pwr_state {
+    ADPD_PWR_OFF,
+    ADPD_PWR_IDLE,
+    ADPD_PWR_SLEEP,
+    ADPD_PWR_ACTIVE,
+};
 
-        err = adi_adpd6000_ppg_led_set_count(&adpd6000_dev, slot_B, num_int_B, num_repeat_B);
-        if (adpd_check_error(err, "ppg_led_set_count B")) return err;
-        k_msleep(50);
+#define ADPD_OSC_SETTLE_MS  1
+#define ADPD_IMG_REGS       435u
+#define ADPD_IMG_SLOT(b)    { (b), (b) + 0x11u }, { (b) + 0x13u, (b) + 0x19u }
+
+/* SYS_CTL (0x0F), status, timestamp and FIFO data registers are left out */
+static const struct { uint16_t first, last; } adpd_img_ranges[] = {
+    { 0x0006, 0x0006 }, { 0x0009, 0x000E }, { 0x0010, 0x0010 }, { 0x0014, 0x001B },
+    { 0x001E, 0x001E }, { 0x0020, 0x0024 }, { 0x0026, 0x0026 }, { 0x0100, 0x0103 },
+    ADPD_IMG_SLOT(0x0120), ADPD_IMG_SLOT(0x0140), ADPD_IMG_SLOT(0x0160), ADPD_IMG_SLOT(0x0180),
+    ADPD_IMG_SLOT(0x01A0), ADPD_IMG_SLOT(0x01C0), ADPD_IMG_SLOT(0x01E0), ADPD_IMG_SLOT(0x0200),
+    ADPD_IMG_SLOT(0x0220), ADPD_IMG_SLOT(0x0240), ADPD_IMG_SLOT(0x0260), ADPD_IMG_SLOT(0x0280),
+    { 0x02A0, 0x02B1 }, { 0x02C0, 0x02D1 }, { 0x02E0, 0x02F1 }, { 0x0300, 0x0311 },
+    { 0x0320, 0x0331 }, { 0x0340, 0x0351 },
+};
 
-        err = adi_adpd6000_ppg_set_minperiod(&adpd6000_dev, slot_B, min_period_B);
-        if (adpd_check_error(err, "ppg_set_minperiod B")) return err;
-        k_msleep(50);
+static enum adpd_pwr_state adpd_pwr_state;
+static uint16_t adpd_img[ADPD_IMG_REGS];
+static bool     adpd_img_valid;
+
+static struct rec_wake adpd_wake_last;
+
+static int adpd6000_afe_set_go(bool enable)
+{
+    int32_t err = adi_adpd6000_device_enable_slot_operation_mode_go(&adpd6000_dev, enable);
+    if (adpd_check_error(err, enable ? "AFE GO ON" : "AFE GO OFF")) {
+        return -EIO;
     }
+    adpd_pwr_state = enable ? ADPD_PWR_ACTIVE : ADPD_PWR_IDLE;
+    return 0;
+}
 
-    err = adi_adpd6000_ppg_sel_precon(&adpd6000_dev, slot_A, API_ADPD6000_PPG_PRECON_AFE_VREF);
-    if (adpd_check_error(err, "ppg_sel_precon A")) return err;
-    k_msleep(50);
+/* restore == false caches the image, otherwise mismatches are written back */
+static int adpd6000_img_walk(bool restore, uint16_t *fixed)
+{
+    uint32_t n = 0;
+    uint16_t v;
+    int32_t err;
 
-    err = adi_adpd6000_ppg_sel_precon(&adpd6000_dev, slot_B, API_ADPD6000_PPG_PRECON_AFE_VREF);
-    if (adpd_check_error(err, "ppg_sel_precon B")) return err;
-    k_msleep(50);
+    for (uint32_t r = 0; r < ARRAY_SIZE(adpd_img_ranges); r++) {
+        for (uint32_t a = adpd_img_ranges[r].first; a <= adpd_img_ranges[r].last && n < ADPD_IMG_REGS; a++, n++) {
+            err = adi_adpd6000_hal_reg_read(&adpd6000_dev, a, &v);
+            if (adpd_check_error(err, "img reg_read")) return err;
+
+            if (!restore) {
+                adpd_img[n] = v;
+            } else if (v != adpd_img[n]) {
+                err = adi_adpd6000_hal_reg_write(&adpd6000_dev, a, adpd_img[n]);
+                if (adpd_check_error(err, "img reg_write")) return err;
+                (*fixed)++;
+            }
+        }
+    }
+    return 0;
+}
 
-    err = adi_adpd6000_ppg_sel_afe_path(&adpd6000_dev, slot_A, API_ADPD6000_PPG_AFE_PATH_TIA_BUF_ADC_1X);
-    if (adpd_check_error(err, "ppg_sel_afe_path A")) return err;
-    k_msleep(50);
+static int adpd6000_afe_sleep(void)
+{
+    int32_t err;
 
-    err = adi_adpd6000_ppg_sel_afe_path(&adpd6000_dev, slot_B, API_ADPD6000_PPG_AFE_PATH_TIA_BUF_ADC_1X);
-    if (adpd_check_error(err, "ppg_sel_afe_path B")) return err;
-    k_msleep(50);
+    if (adpd_pwr_state == ADPD_PWR_OFF || adpd_pwr_state == ADPD_PWR_SLEEP) {
+        return 0;
+    }
+    if (adpd_pwr_state == ADPD_PWR_ACTIVE) {
+        err = adpd6000_afe_set_go(false);
+        if (err) return err;
+    }
 
-    err = adi_adpd6000_ppg_config_vc(&adpd6000_dev, slot_A, vc_index,
-                                     API_ADPD6000_PPG_VC_DELTA,
-                                     API_ADPD6000_PPG_VC_VDD,
-                                     API_ADPD6000_PPG_VC_PULSE_NO);
-    if (adpd_check_error(err, "ppg_config_vc A")) return err;
-    k_msleep(50);
+    adpd_img_valid = adpd6000_img_walk(false, NULL) == 0;
 
-    err = adi_adpd6000_ppg_config_vc(&adpd6000_dev, slot_B, vc_index,
-                                     API_ADPD6000_PPG_VC_DELTA,
-                                     API_ADPD6000_PPG_VC_VDD,
-                                     API_ADPD6000_PPG_VC_PULSE_NO);
-    if (adpd_check_error(err, "ppg_config_vc B")) return err;
-    k_msleep(50);
+    err = adi_adpd6000_device_enbale_sleep_mode(&adpd6000_dev, true);
+    if (adpd_check_error(err, "device_enbale_sleep_mode(true)")) return err;
 
-    {
-        uint8_t dc_current   = 0;
-        uint8_t dc_current_B = 15;
+    err = adi_adpd6000_hal_bf_write(&adpd6000_dev, BF_OSC_960K_EN_INFO, 0);
+    if (adpd_check_error(err, "osc_960k off")) return err;
 
-        err = adi_adpd6000_ppg_set_dcdac(&adpd6000_dev, slot_A, channel_1, dc_current);
-        if (adpd_check_error(err, "ppg_set_dcdac A")) return err;
-        k_msleep(50);
+    adpd_pwr_state = ADPD_PWR_SLEEP;
+    return 0;
+}
 
-        err = adi_adpd6000_ppg_set_dcdac(&adpd6000_dev, slot_B, channel_1, dc_current_B);
-        if (adpd_check_error(err, "ppg_set_dcdac B")) return err;
-        k_msleep(50);
+static int adpd6000_afe_wake(void)
+{
+    uint32_t t0 = k_cycle_get_32();
+    uint16_t fixed = 0;
+    int32_t err;
+
+    if (adpd_pwr_state != ADPD_PWR_SLEEP) {
+        adpd_wake_last = (struct rec_wake){0};
+        return 0;
     }
 
-    {
-        uint8_t signal_size = 4;
-        uint8_t lit_size    = 4;
-        uint8_t dark_size   = 4;
+    err = adi_adpd6000_hal_bf_write(&adpd6000_dev, BF_OSC_960K_EN_INFO, 1);
+    if (adpd_check_error(err, "osc_960k on")) return err;
+    k_msleep(ADPD_OSC_SETTLE_MS);
 
-        err = adi_adpd6000_ppg_set_data_size(&adpd6000_dev, slot_A, signal_size, lit_size, dark_size);
-        if (adpd_check_error(err, "ppg_set_data_size A")) return err;
-        k_msleep(50);
+    err = adi_adpd6000_device_enbale_sleep_mode(&adpd6000_dev, false);
+    if (adpd_check_error(err, "device_enbale_sleep_mode(false)")) return err;
 
-        err = adi_adpd6000_ppg_set_data_size(&adpd6000_dev, slot_B, signal_size, lit_size, dark_size);
-        if (adpd_check_error(err, "ppg_set_data_size B")) return err;
-        k_msleep(50);
+    if (adpd_img_valid) {
+        err = adpd6000_img_walk(true, &fixed);
+        if (err) return err;
     }
+    adpd_pwr_state = ADPD_PWR_IDLE;
 
-    {
-        uint8_t signal_offset = 0;
-        uint8_t lit_offset    = 0;
-        uint8_t dark_offset   = 0;
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - t0);
 
-        err = adi_adpd6000_ppg_set_window_offset(&adpd6000_dev, slot_A, signal_offset, lit_offset, dark_offset);
-        if (adpd_check_error(err, "ppg_set_window_offset A")) return err;
-        k_msleep(50);
+    adpd_wake_last.us    = (uint16_t)MIN(us, UINT16_MAX);
+    adpd_wake_last.fixed = fixed;
+    return 0;
+}
 
-        err = adi_adpd6000_ppg_set_window_offset(&adpd6000_dev, slot_B, signal_offset, lit_offset, dark_offset);
-        if (adpd_check_error(err, "ppg_set_window_offset B")) return err;
-        k_msleep(50);
+int adpd6000_init_config(void)
+{
+    int32_t err;
+
+    if (!device_is_ready(adpd_spi_dev)) {
+        return -ENODEV;
     }
 
-    err = adi_adpd6000_ppg_set_alctype(&adpd6000_dev, slot_A, API_ADPD6000_PPG_ALC_COARSE_FINE);
-    if (adpd_check_error(err, "ppg_set_alctype A")) return err;
+    adpd_pwr_state = ADPD_PWR_OFF;
+    adpd_img_valid = false;
+
+    memset(&adpd6000_dev, 0, sizeof(adpd6000_dev));
+    adpd6000_dev.user_data = NULL;
+    adpd6000_dev.write     = adpd6000_spi_write;
+    adpd6000_dev.read      = adpd6000_spi_read;
+    adpd6000_dev.log_write = adpd6000_log_write;
+
+    err = adi_adpd6000_device_sw_reset(&adpd6000_dev);
+    if (adpd_check_error(err, "device_sw_reset")) return err;
+    k_msleep(100);
+
+    if (!adpd6000_verify_connected()) {
+        return -ENODEV;
+    }
+
+    err = adi_adpd6000_device_init(&adpd6000_dev);
+    if (adpd_check_error(err, "device_init")) return err;
+    k_msleep(100);
+
+
+    err = adi_adpd6000_device_enable_internal_osc_960k(&adpd6000_dev);
+    if (adpd_check_error(err, "enable_internal_osc_960k")) return err;
+    k_msleep(100);
+
+
+    uint8_t pair_12  = 0;
+    uint8_t pair_34  = 1;
+
+    err = adi_adpd6000_ppg_enable_input_diff_mode(&adpd6000_dev, pair_12, false);
+    if (adpd_check_error(err, "ppg_enable_input_diff_mode pair_12")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_set_alctype(&adpd6000_dev, slot_B, API_ADPD6000_PPG_ALC_COARSE_FINE);
-    if (adpd_check_error(err, "ppg_set_alctype B")) return err;
+    err = adi_adpd6000_ppg_enable_input_diff_mode(&adpd6000_dev, pair_34, false);
+    if (adpd_check_error(err, "ppg_enable_input_diff_mode pair_34")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_set_sample_type(&adpd6000_dev, slot_A, API_ADPD6000_PPG_SAMPLE_TYPE_TWO_REGION);
-    if (adpd_check_error(err, "ppg_set_sample_type A")) return err;
+    err = adi_adpd6000_ppg_set_sleep_input_mux(&adpd6000_dev, pair_12, API_ADPD6000_PPG_INPUT_SLEEP_BOTH_CATH1);
+    if (adpd_check_error(err, "ppg_set_sleep_input_mux pair_12")) return err;
+    k_msleep(50);
+
+    err = adi_adpd6000_ppg_set_sleep_input_mux(&adpd6000_dev, pair_34, API_ADPD6000_PPG_INPUT_SLEEP_BOTH_CATH1);
+    if (adpd_check_error(err, "ppg_set_sleep_input_mux pair_34")) return err;
     k_msleep(50);
 
-    err = adi_adpd6000_ppg_set_sample_type(&adpd6000_dev, slot_B, API_ADPD6000_PPG_SAMPLE_TYPE_TWO_REGION);
-    if (adpd_check_error(err, "ppg_set_sample_type B")) return err;
+    err = adi_adpd6000_ppg_set_cathode(&adpd6000_dev,
+                                       API_ADPD6000_PPG_CATH_VDD,
+                                       API_ADPD6000_PPG_CATH_VDD);
+    if (adpd_check_error(err, "ppg_set_cathode")) return err;
     k_msleep(50);
 
+    for (uint8_t slot = 0; slot < PPG_NUM_SLOTS; slot++) {
+        err = adpd6000_ppg_slot_config(slot, &ppg_slots[slot]);
+        if (err) return err;
+    }
+    /* red and IR integrate a different number of pulses */
+    for (uint32_t ch = 0; ch < 2u; ch++) {
+        ppg_full_scale[ch] = 16383u * ppg_slots[ch].num_int * ppg_slots[ch].num_repeat;
+    }
+
+    if (ECG_MODE_ENABLE) {
+        err = adpd6000_ecg_config();
+        if (err) return err;
+    }
+
+    if (BIOZ_MODE_ENABLE) {
+        err = adpd6000_bioz_config();
+        if (err) return err;
+#ifdef CONFIG_BOARD_NATIVE_SIM
+        err = adpd6000_bioz_selftest();
+        if (err) return err;
+#endif
+    }
+
+    err = adpd6000_apply_profile(&capture_profile);
+    if (err) return err;
+
     {
         uint16_t threshold = 4;
 
@@ -471,10 +810,6 @@ int adpd6000_init_config(void)
         if (adpd_check_error(err, "device_set_fifo_threshold")) return err;
         k_msleep(50);
 
-        err = adi_adpd6000_device_get_sequence_fifo_config(&adpd6000_dev, &adpd_fifo_cfg);
-        if (adpd_check_error(err, "device_get_sequence_fifo_config")) return err;
-        k_msleep(50);
-
         err = adi_adpd6000_device_enable_fifo_thres_interrupt(&adpd6000_dev,
                                                               API_ADPD6000_INTERRUPT_X, true);
         if (adpd_check_error(err, "device_enable_fifo_thres_interrupt")) return err;
@@ -485,138 +820,730 @@ int adpd6000_init_config(void)
     if (adpd_check_error(err, "device_enable_slot_operation_mode_go(false)")) return err;
     k_msleep(20);
 
-    return 0;
+    adpd_pwr_state = ADPD_PWR_IDLE;
+    return adpd6000_afe_sleep();
+}
+
+/*
+ * One FIFO sequence in a single SPI burst, parsed here instead of through the
+ * SDK readers, which issue one transaction per field (14 per sequence with
+ * 2 ECG samples, 2 PPG slots and 4 BioZ slots). Each frame is ECG samples,
+ * then signal/dark/lit per PPG slot, then BioZ real/imag per slot; with the
+ * PPG decimator on, PPG is only present in the last of adpd_decim frames.
+ */
+
+struct adpd_seq {
+    uint32_t sig[PPG_NUM_SLOTS];
+    uint32_t amb[PPG_NUM_SLOTS];
+    uint8_t  frames;
+    uint32_t ecg[PPG_DECIM_MAX][ECG_SEQ_MAX];
+    uint8_t  ecg_num[PPG_DECIM_MAX];
+    uint32_t bioz_re[PPG_DECIM_MAX][BIOZ_SLOTS];
+    uint32_t bioz_im[PPG_DECIM_MAX][BIOZ_SLOTS];
+    uint8_t  bioz_num;
+};
+
+static struct {
+    uint32_t cycles;
+    uint32_t reads;
+    uint32_t status_cycles;
+    uint32_t status_reads;
+} adpd_burst_stats;
+
+/*
+ * Per-slot cost of the burst path: the status read is one transaction with
+ * 2 data bytes, the burst one with adpd_seq_bytes, so their difference is
+ * the data phase alone and a PPG slot costs its share of it.
+ */
+static void adpd_burst_cost(struct rec_burst *b)
+{
+    const adi_adpd6000_ppg_fifo_config_t *f = &adpd_fifo_cfg.ppg_fifo[0];
+    uint32_t slot_bytes = f->signal_size + f->dark_size + f->lit_size;
+
+    *b = (struct rec_burst){ .seq_bytes = adpd_seq_bytes };
+    if (!adpd_burst_stats.reads || !adpd_burst_stats.status_reads) {
+        return;
+    }
+
+    uint32_t burst_ns  = (uint32_t)(k_cyc_to_ns_floor64(adpd_burst_stats.cycles) /
+                                    adpd_burst_stats.reads);
+    uint32_t status_ns = (uint32_t)(k_cyc_to_ns_floor64(adpd_burst_stats.status_cycles) /
+                                    adpd_burst_stats.status_reads);
+
+    b->burst_us_x10  = (uint16_t)MIN(burst_ns / 100u, UINT16_MAX);
+    b->status_us_x10 = (uint16_t)MIN(status_ns / 100u, UINT16_MAX);
+    if (burst_ns > status_ns && adpd_seq_bytes > 2u) {
+        uint32_t slot_ns = (burst_ns - status_ns) * slot_bytes / (adpd_seq_bytes - 2u);
+
+        b->slot_us_x10 = (uint16_t)MIN(slot_ns / 100u, UINT16_MAX);
+    }
 }
 
-static int adpd6000_read_ppg_pair(uint32_t *ppg_red, uint32_t *ppg_ir)
+static uint32_t adpd_take_be(const uint8_t **p, uint8_t n)
 {
-    uint32_t signal_data[2] = {0};
-    uint32_t dark_data[2]   = {0};
-    uint32_t lit_data[2]    = {0};
-    uint8_t  ppg_num        = 0;
+    uint32_t v = 0;
 
-    int32_t err = adi_adpd6000_ppg_read_fifo(&adpd6000_dev, &adpd_fifo_cfg,
-                                             signal_data, dark_data, lit_data, &ppg_num);
+    while (n--) {
+        v = (v << 8) | *(*p)++;
+    }
+    return v;
+}
+
+/*
+ * Returns -EOVERFLOW when the FIFO overflowed since the last drain. Its
+ * contents are no longer sequence-aligned, so it is cleared and the caller
+ * accounts for the missing samples.
+ */
+static int adpd6000_read_sequence(struct adpd_seq *s)
+{
+    static uint8_t raw[ADPD_SEQ_MAX_BYTES];
+    const uint8_t *p = raw;
+    uint16_t status = 0;
+    uint16_t count;
+    int32_t  err;
+    uint32_t t0;
+
+    t0 = k_cycle_get_32();
+    err = adi_adpd6000_hal_reg_read(&adpd6000_dev, REG_FIFO_STATUS_ADDR, &status);
     if (err != API_ADPD6000_ERROR_OK) {
-        adpd_check_error(err, "ppg_read_fifo");
+        adpd_check_error(err, "fifo status");
         return -EIO;
     }
-
-    if (ppg_num < 1) {
+    adpd_burst_stats.status_cycles += k_cycle_get_32() - t0;
+    adpd_burst_stats.status_reads++;
+    adpd_drain_ticks = k_uptime_ticks();
+    count = status & ADPD_FIFO_COUNT_MASK;
+    adpd_fifo_health.hwm_bytes = MAX(adpd_fifo_health.hwm_bytes, count);
+
+    if (status & (ADPD_FIFO_OFLOW | ADPD_FIFO_UFLOW)) {
+        err = adi_adpd6000_hal_reg_write(&adpd6000_dev, REG_FIFO_STATUS_ADDR,
+                                         status & (ADPD_FIFO_OFLOW | ADPD_FIFO_UFLOW));
+        if (adpd_check_error(err, "fifo status clear")) return -EIO;
+        if ((status & ADPD_FIFO_UFLOW) && adpd_fifo_health.uflow < UINT8_MAX) {
+            adpd_fifo_health.uflow++;
+        }
+    }
+    if (status & ADPD_FIFO_OFLOW) {
+        err = adi_adpd6000_device_clr_fifo(&adpd6000_dev);
+        if (adpd_check_error(err, "device_clr_fifo")) return -EIO;
+        return -EOVERFLOW;
+    }
+    if (count < adpd_seq_bytes) {
         return -EAGAIN;
     }
 
-    *ppg_red = signal_data[0];
-    *ppg_ir  = signal_data[1];
+    t0 = k_cycle_get_32();
+    err = adi_adpd6000_device_fifo_read_bytes(&adpd6000_dev, raw, adpd_seq_bytes);
+    if (err != API_ADPD6000_ERROR_OK) {
+        adpd_check_error(err, "device_fifo_read_bytes");
+        return -EIO;
+    }
+    adpd_burst_stats.cycles += k_cycle_get_32() - t0;
+    adpd_burst_stats.reads++;
+    adpd_fifo_left = count - adpd_seq_bytes;
+
+    s->frames   = adpd_decim;
+    s->bioz_num = adpd_fifo_cfg.bioz_slot;
+
+    for (uint8_t fr = 0; fr < adpd_decim; fr++) {
+        s->ecg_num[fr] = 0;
+        for (uint8_t i = 0; adpd_fifo_cfg.ecg_slot && i < adpd_fifo_cfg.ecg_over_sample; i++) {
+            uint32_t v = adpd_take_be(&p, adpd_fifo_cfg.ecg_size);
+
+            /* a 0xFF status byte marks a placeholder entry, as in ecg_read_fifo() */
+            if (adpd_fifo_cfg.ecg_size == 4 && (v >> 24) == 0xFFu) {
+                continue;
+            }
+            s->ecg[fr][s->ecg_num[fr]++] = v;
+        }
+
+        for (uint8_t i = 0; fr + 1u == adpd_decim && i < adpd_fifo_cfg.ppg_slot; i++) {
+            const adi_adpd6000_ppg_fifo_config_t *f = &adpd_fifo_cfg.ppg_fifo[i];
+
+            /* decimator output is the sum; keep the per-sample scale */
+            s->sig[i] = (adpd_take_be(&p, f->signal_size) + adpd_decim / 2u) / adpd_decim;
+            s->amb[i] = (adpd_take_be(&p, f->dark_size) + adpd_decim / 2u) / adpd_decim;
+            (void)adpd_take_be(&p, f->lit_size);
+        }
+
+        for (uint8_t i = 0; i < adpd_fifo_cfg.bioz_slot; i++) {
+            s->bioz_re[fr][i] = adpd_take_be(&p, 3);
+            s->bioz_im[fr][i] = adpd_take_be(&p, 3);
+        }
+    }
     return 0;
 }
 
-void init_i2c(void)
+/*
+ * Placeholder entries the SDK drops are refilled with the previous sample so
+ * that ECG tick i * ECG_OVERSAMPLE stays aligned with PPG sample i.
+ */
+static void ecg_push(const uint32_t *raw, uint8_t n)
 {
-    if (!device_is_ready(i2c_dev)) {
-        printk("I2C0 NOT READY\n");
-    } else {
-        printk("I2C0 OK\n");
+    int32_t x[ECG_SEQ_MAX];
+    uint8_t want = MIN(adpd_fifo_cfg.ecg_over_sample, ECG_SEQ_MAX);
+
+    for (uint8_t k = 0; k < want; k++) {
+        if (k < n) {
+            uint32_t v = raw[k];
+
+            if (adpd_fifo_cfg.ecg_size == 4) {
+                ecg_status |= (uint8_t)(v >> 24);
+            }
+            x[k] = (int32_t)(v << 8) >> 8;
+        } else {
+            x[k] = (k > 0) ? x[k - 1u] : (ecg_len ? ecg_buf[ecg_len - 1u] : 0);
+        }
+        if (ecg_len < ECG_LEN) {
+            ecg_buf[ecg_len++] = x[k];
+        }
     }
+    ecg_qrs_process(x, want);
 }
 
-static int tmp117_read_raw(int16_t *raw)
+static void bioz_push_raw(const uint32_t *re, const uint32_t *im)
 {
-    uint8_t reg = 0x00;
-    uint8_t data[2];
+    int32_t x[BIOZ_SLOTS], y[BIOZ_SLOTS];
 
-    if (!device_is_ready(i2c_dev)) {
-        return -ENODEV;
+    for (uint32_t k = 0; k < BIOZ_SLOTS; k++) {
+        x[k] = (int32_t)(re[k] << 8) >> 8;
+        y[k] = (int32_t)(im[k] << 8) >> 8;
+    }
+    bioz_push(x, y);
+}
+
+/*
+ * After an overflow the FIFO is empty, so every sample produced since
+ * t_start and not yet read is gone. Returns how many window samples from
+ * index i on are held at the last value to keep a uniform time axis.
+ */
+static uint32_t adpd_fifo_gap(uint32_t i, uint32_t n, uint32_t t_start, uint16_t fs_hz)
+{
+    uint32_t due  = (uint32_t)(((uint64_t)(k_uptime_get_32() - t_start) * fs_hz) / 1000u);
+    uint32_t lost = MIN((due > i) ? due - i : 1u, n - i);
+    struct fifo_health *f = &adpd_fifo_health;
+
+    if (f->oflow < REC_GAP_MAX) {
+        f->gap_pos[f->oflow] = (uint16_t)i;
+        f->gap_len[f->oflow] = (uint16_t)lost;
+    }
+    if (f->oflow < UINT8_MAX) {
+        f->oflow++;
+    }
+    f->lost += (uint16_t)lost;
+    return lost;
+}
+
+static int32_t ppg_fix_jump(int32_t prev, int32_t raw)
+{
+    int32_t v = raw;
+
+    if (prev - v > PPG_WRAP_DETECT) {
+        v += PPG_WRAP_STEP;
+    }
+    if (prev - v > PPG_STEP_DETECT) {
+        v += PPG_STEP_SIZE;
+    } else if (prev - v < -PPG_STEP_DETECT) {
+        v -= PPG_STEP_SIZE;
+    }
+    return v;
+}
+
+void measure_agc_invalidate(void)
+{
+    ppg_agc_cache.valid = false;
+}
+
+/* reloads the factory 960 kHz trim; the new trim is kept in the sleep image */
+int measure_session_start(void)
+{
+    int32_t err = API_ADPD6000_ERROR_OK;
+    int ret;
+
+    if (!ADPD_OSC_CAL_SESSION) {
+        return 0;
     }
 
-    int ret = i2c_write_read(i2c_dev, TMP117_ADDR, &reg, 1, data, 2);
-    if (ret < 0) {
+    ret = adpd6000_afe_wake();
+    if (ret) {
         return ret;
     }
+    err = adi_adpd6000_device_cal_960k_osc(&adpd6000_dev);
+    if (err != API_ADPD6000_ERROR_OK) {
+        printk("960k osc cal failed (%d)\n", err);
+    }
+    adpd_pwr_state = ADPD_PWR_IDLE;
+    ret = adpd6000_afe_sleep();
 
-    *raw = ((int16_t)data[0] << 8) | data[1];
-    return 0;
+    return (err != API_ADPD6000_ERROR_OK) ? -EIO : ret;
 }
 
-static float tmp117_read_celsius(void)
+/*
+ * Effective sample rate from drain timestamps. Only drains that emptied
+ * the FIFO are used: the sequence read was then the newest one, so its
+ * timestamp trails the sample by less than one poll interval. A least-
+ * squares line through (index, ticks) gives the rate and the time of
+ * sample 0; the residual RMS is the timestamp jitter.
+ *
+ * The fit runs on r = t * fs - di * TICKS_PER_SEC, the timestamp's offset
+ * from the nominal rate in 1/fs ticks. r stays small, so the centred sums
+ * are exact in int64 and only the final ratios need float.
+ */
+#define TS_TPS  CONFIG_SYS_CLOCK_TICKS_PER_SEC
+
+struct ts_fit {
+    int64_t  t_first;
+    uint32_t i_first;
+    uint32_t fs_hz;
+    uint32_t n;
+    int64_t  si, sr, sii, sir, srr;
+};
+
+static void ts_fit_add(struct ts_fit *f, uint32_t i, int64_t ticks)
 {
-    int16_t raw;
-    if (tmp117_read_raw(&raw) < 0) {
-        return 25.0f;
+    if (f->n == 0) {
+        f->t_first = ticks;
+        f->i_first = i;
     }
-    return raw * 0.0078125f;
+    int64_t di = i - f->i_first;
+    int64_t r  = (ticks - f->t_first) * f->fs_hz - di * TS_TPS;
+
+    f->n++;
+    f->si  += di;
+    f->sr  += r;
+    f->sii += di * di;
+    f->sir += di * r;
+    f->srr += r * r;
 }
 
-static int adpd6000_afe_set_go(bool enable)
+static void ts_fit_finish(const struct ts_fit *f, struct rec_timebase *tb)
 {
-    int32_t err = adi_adpd6000_device_enable_slot_operation_mode_go(&adpd6000_dev, enable);
-    if (adpd_check_error(err, enable ? "AFE GO ON" : "AFE GO OFF")) {
-        return -EIO;
+    int64_t n   = f->n;
+    int64_t sii = n * f->sii - f->si * f->si;
+    int64_t sir = n * f->sir - f->si * f->sr;
+    int64_t srr = n * f->srr - f->sr * f->sr;
+
+    memset(tb, 0, sizeof(*tb));
+    tb->points = (uint16_t)MIN(f->n, UINT16_MAX);
+    if (f->n < 2u || f->fs_hz == 0 || sii <= 0) {
+        return;
+    }
+
+    float fs      = (float)f->fs_hz;
+    float slope_r = (float)sir / (float)sii;
+    float slope_t = ((float)TS_TPS + slope_r) / fs;
+    float icpt_t  = ((float)f->sr - slope_r * (float)f->si) / ((float)n * fs);
+    float rss     = MAX((float)srr - slope_r * (float)sir, 0.0f);
+    float rms_t   = sqrtf(rss) / ((float)n * fs);
+    int64_t t0    = f->t_first + (int64_t)lroundf(icpt_t - (float)f->i_first * slope_t);
+
+    if (slope_t <= 0.0f) {
+        return;
+    }
+
+    /* fs * TPS / (TPS + slope_r), written as a correction to stay exact */
+    tb->fs_mhz    = (uint32_t)(1000.0f * fs - 1000.0f * fs * slope_r / ((float)TS_TPS + slope_r) + 0.5f);
+    tb->t0_ms     = (uint32_t)k_ticks_to_ms_near64((uint64_t)MAX(t0, 0));
+    tb->jitter_us = (uint16_t)MIN(rms_t * 1e6f / (float)TS_TPS + 0.5f, (float)UINT16_MAX);
+}
+
+static int adpd6000_agc_apply_cached(void)
+{
+    int32_t err;
+
+    for (uint8_t slot = 0; slot < PPG_NUM_SLOTS; slot++) {
+        err = adi_adpd6000_ppg_tia_set_gain_res(&adpd6000_dev, slot, ppg_agc_cfg.slot[slot].tia_chnl,
+                                                (adi_adpd6000_ppg_tia_gain_res_e)ppg_agc_cache.tia[slot]);
+        if (adpd_check_error(err, "AGC cached TIA gain")) return -EIO;
+
+        err = adi_adpd6000_ppg_led_set_current(&adpd6000_dev, slot, ppg_agc_cfg.slot[slot].led_chnl,
+                                               ppg_agc_cache.led[slot]);
+        if (adpd_check_error(err, "AGC cached LED current")) return -EIO;
     }
     return 0;
 }
 
+/*
+ * The SDK only sets agc_done in its low-TIA-gain branch, which raises LED
+ * current. In low-LED-current mode a one-shot slot is done once a pass
+ * (skip + average samples, ending with ppg_sample_count back at 0) leaves
+ * LED current and TIA gain unchanged.
+ */
+static void adpd6000_agc_track(void)
+{
+    if (ppg_sample_count != 0) {
+        return;
+    }
+
+    for (int i = 0; i < PPG_NUM_SLOTS; i++) {
+        if (ppg_agc_cfg.slot[i].agc_type &&
+            ppg_agc_run[i].led_current == ppg_agc_prev.led[i] &&
+            ppg_agc_run[i].tia_gain == ppg_agc_prev.tia[i]) {
+            ppg_agc_run[i].agc_done = 1;
+        }
+        ppg_agc_prev.led[i] = ppg_agc_run[i].led_current;
+        ppg_agc_prev.tia[i] = ppg_agc_run[i].tia_gain;
+    }
+}
+
+static void adpd6000_agc_store(void)
+{
+    bool done = true;
+
+    for (int i = 0; i < PPG_NUM_SLOTS; i++) {
+        if (ppg_agc_cfg.slot[i].agc_type && !ppg_agc_run[i].agc_done) {
+            done = false;
+        }
+    }
+    if (!done) {
+        return;
+    }
+
+    for (int i = 0; i < PPG_NUM_SLOTS; i++) {
+        ppg_agc_cache.led[i] = ppg_agc_run[i].led_current;
+        ppg_agc_cache.tia[i] = ppg_agc_run[i].tia_gain;
+    }
+    ppg_agc_cache.valid = true;
+}
+
+/*
+ * White-noise floor in counts from the second difference, whose variance is
+ * 6 sigma^2 and which suppresses the pulse itself. Used to compare direct
+ * sampling against AFE decimation on the same subject.
+ */
+static float ppg_noise_floor(const int32_t *x, uint32_t n)
+{
+    float acc = 0.0f;
+
+    for (uint32_t i = 1; i + 1u < n; i++) {
+        float d = (float)x[i + 1u] - 2.0f * (float)x[i] + (float)x[i - 1u];
+
+        acc += d * d;
+    }
+    return (n > 2u) ? sqrtf(acc / (6.0f * (float)(n - 2u))) : 0.0f;
+}
+
+/*
+ * The on-device chain (FIR filters, vitals, PTT, BioZ, BP model) is designed
+ * for PPG_FS_HZ. Other profile rates record raw windows with an NA summary
+ * and leave the analysis to the host; ECG QRS runs at ECG_FS_HZ regardless.
+ */
 int measure_ppg_template(void)
 {
-    uint32_t ppg_red = 0, ppg_ir = 0;
-    int ret = 0;
+    static struct adpd_seq seq;
+    struct capture_profile prof;
+    struct ts_fit fit = {0};
+    int32_t  sig[PPG_NUM_SLOTS] = {0};
+    int32_t  dark[PPG_NUM_SLOTS] = {0};
+    int64_t  amb_sum[PPG_NUM_SLOTS] = {0};
+    int ret;
+
+    ret = adpd6000_afe_wake();
+    if (ret) {
+        return ret;
+    }
+    template_wake = adpd_wake_last;
+
+    measure_get_profile(&prof);
+    fit.fs_hz = prof.fs_hz;
+    if (prof.fs_hz != capture_profile_hw.fs_hz || prof.channels != capture_profile_hw.channels ||
+        prof.decim != capture_profile_hw.decim) {
+        ret = adpd6000_apply_profile(&prof);
+        if (ret) {
+            goto out_poweroff;
+        }
+        measure_agc_invalidate();
+    }
+
+    bool on_device = prof.fs_hz == PPG_FS_HZ;
+    uint32_t period_ms = 1000u / prof.fs_hz;
+    bool agc_run = PPG_AGC_CONTINUOUS || !ppg_agc_cache.valid;
+
+    if (!agc_run) {
+        ret = adpd6000_agc_apply_cached();
+        if (ret) {
+            goto out_poweroff;
+        }
+    }
 
     ret = adpd6000_afe_set_go(true);
     if (ret) {
-        return ret;
+        goto out_poweroff;
+    }
+
+    if (agc_run &&
+        adpd_check_error(adi_adpd6000_ppg_agc_init(&adpd6000_dev, &adpd_fifo_cfg, &ppg_agc_cfg),
+                         "ppg_agc_init")) {
+        agc_run = false;
+    }
+    for (int i = 0; agc_run && i < PPG_NUM_SLOTS; i++) {
+        ppg_agc_prev.led[i] = ppg_agc_run[i].led_current;
+        ppg_agc_prev.tia[i] = ppg_agc_run[i].tia_gain;
     }
 
     uint32_t elapsed_ms = 0;
-    while (elapsed_ms < 3800) {
-        k_msleep(8);
-        elapsed_ms += 8;
-        (void)adpd6000_read_ppg_pair(&ppg_red, &ppg_ir);
+    while (elapsed_ms < prof.warmup_ms) {
+        k_msleep(period_ms);
+        elapsed_ms += period_ms;
+        if (adpd6000_read_sequence(&seq) == 0 && agc_run) {
+            (void)adi_adpd6000_ppg_agc_process(&adpd6000_dev, &adpd_fifo_cfg, &ppg_agc_cfg, seq.sig);
+            adpd6000_agc_track();
+        }
     }
 
-    for (uint32_t i = 0; i < VEC_LEN; i++) {
+    if (agc_run) {
+        adpd6000_agc_store();
+    }
+
+    ppg_filter_reset();
+    vitals_reset(ppg_full_scale);
+    ecg_qrs_reset();
+    ptt_reset();
+    bioz_reset(prof.decim);
+    memset(ecg_buf, 0, sizeof(ecg_buf));
+    ecg_len    = 0;
+    ecg_status = 0;
+    memset(&adpd_burst_stats, 0, sizeof(adpd_burst_stats));
+    memset(&adpd_fifo_health, 0, sizeof(adpd_fifo_health));
+    memset(ppg_buf, 0, sizeof(ppg_buf));
+
+    uint32_t t_start = k_uptime_get_32();
+    uint32_t hold = 0;
+
+    tmp117_start();
+
+    for (uint32_t i = 0; i < prof.win_len; i++) {
+        bool held = hold > 0u;
         int r;
-        do {
-            r = adpd6000_read_ppg_pair(&ppg_red, &ppg_ir);
-            if (r == -EAGAIN) {
-                k_msleep(1);
-            } else if (r != 0) {
-                ret = r;
-                goto out_poweroff;
+
+        if (held) {
+            hold--;
+        } else {
+            do {
+                r = adpd6000_read_sequence(&seq);
+                if (r == -EOVERFLOW && i == 0) {
+                    t_start = k_uptime_get_32();
+                    r = -EAGAIN;
+                }
+                if (r == -EAGAIN) {
+                    k_msleep(1);
+                } else if (r == -EOVERFLOW) {
+                    hold = adpd_fifo_gap(i, prof.win_len, t_start, prof.fs_hz) - 1u;
+                    held = true;
+                } else if (r != 0) {
+                    ret = r;
+                    goto out_poweroff;
+                }
+            } while (r == -EAGAIN);
+
+            if (!held && adpd_fifo_left < adpd_seq_bytes) {
+                ts_fit_add(&fit, i, adpd_drain_ticks);
             }
-        } while (r == -EAGAIN);
+        }
+
+        for (uint32_t fr = 0; fr < seq.frames; fr++) {
+            if (adpd_fifo_cfg.ecg_slot) {
+                ecg_push(seq.ecg[fr], held ? 0 : seq.ecg_num[fr]);
+            }
+            if (on_device && !held && seq.bioz_num == BIOZ_SLOTS) {
+                bioz_push_raw(seq.bioz_re[fr], seq.bioz_im[fr]);
+            }
+        }
+
+        for (uint32_t ch = 0; ch < prof.channels; ch++) {
+            if (!held) {
+                sig[ch]  = (i == 0) ? (int32_t)seq.sig[ch] : ppg_fix_jump(sig[ch], (int32_t)seq.sig[ch]);
+                dark[ch] = (i == 0) ? (int32_t)seq.amb[ch] : ppg_fix_jump(dark[ch], (int32_t)seq.amb[ch]);
+            }
+            amb_sum[ch] += dark[ch];
+            ppg_buf[ch][i] = sig[ch];
+        }
+
+        if (on_device && (i + 1u) % PPG_FILT_BLOCK == 0 && i < PPG_FILT_IN_LEN) {
+            uint32_t b = i + 1u - PPG_FILT_BLOCK;
+            if (ppg_filter_process(&ppg_buf[PPG_CH_RED][b], &ppg_buf[PPG_CH_IR][b], PPG_FILT_BLOCK) == 0) {
+                vitals_update(ppg_buf[PPG_CH_RED], ppg_buf[PPG_CH_IR]);
+            }
+            ptt_update(ppg_buf[PPG_CH_IR], i + 1u);
+        }
+
+        /* held samples fill a gap already in the past; pacing them would
+         * let the FIFO refill faster than it is drained
+         */
+        if (!held) {
+            k_msleep(period_ms);
+        }
+    }
+
+    tmp117_stop(&template_temp);
+
+    /* ppg_buf holds the window; keep the LEDs off during the analysis and the BP model */
+    (void)adpd6000_afe_set_go(false);
+    (void)adpd6000_afe_sleep();
 
-        ppg1_buf[i] = (int32_t)ppg_red;
-        ppg2_buf[i] = (int32_t)ppg_ir;
+    if (on_device) {
+        ptt_update(ppg_buf[PPG_CH_IR], prof.win_len);
+    }
 
-        k_msleep(8);
+    for (uint32_t ch = 0; ch < PPG_NUM_SLOTS; ch++) {
+        template_amb[ch] = (uint32_t)(amb_sum[ch] / prof.win_len);
     }
 
-    template_temp_val = tmp117_read_celsius();
+    ts_fit_finish(&fit, &template_timebase);
+    adpd_burst_cost(&template_burst);
+
+    for (uint32_t ch = 0; ch < 2u; ch++) {
+        template_noise[ch] = (uint16_t)MIN(ppg_noise_floor(ppg_buf[ch], prof.win_len) + 0.5f,
+                                           (float)UINT16_MAX);
+    }
+
+    template_temp_val = (template_temp.flags & TEMP_FLAG_VALID) ? template_temp.mean_x100 / 100.0f : NAN;
+    template_ts_ms    = k_uptime_get_32();
+    template_profile  = prof;
+    template_fifo     = adpd_fifo_health;
+    if (on_device) {
+        vitals_finish(&template_summary);
+    } else {
+        template_summary = (struct rec_summary){ REC_SUM_NA, REC_SUM_NA, REC_SUM_NA, 0, 0 };
+    }
+    template_bioz_rr_x10 = (BIOZ_MODE_ENABLE && on_device) ? bioz_rr_x10() : REC_SUM_NA;
+
+    {
+        float sbp, dbp;
+
+        template_sbp_x10 = REC_SUM_NA;
+        template_dbp_x10 = REC_SUM_NA;
+        if (on_device &&
+            bp_model_infer(ppg_buf[PPG_CH_RED], prof.win_len, &sbp, &dbp) == 0 && sbp > 0.0f && dbp > 0.0f) {
+            template_sbp_x10 = (uint16_t)(sbp * 10.0f + 0.5f);
+            template_dbp_x10 = (uint16_t)(dbp * 10.0f + 0.5f);
+        }
+    }
 
 
 out_poweroff:
-    (void)adpd6000_afe_set_go(false);
+    if (ret) {
+        tmp117_stop(NULL);
+    }
+    /* stops GO first when still active; a no-op once asleep */
+    (void)adpd6000_afe_sleep();
     return ret;
 }
 
-int flash_store_measurement(uint16_t seq)
+bool measure_is_low_quality(void)
 {
-    uint32_t base = FLASH_SEQ_BASE + (uint32_t)seq * SEQ_SLOT_SIZE;
-
+    return (template_summary.flags & REC_SUM_LOW_SQI) != 0;
+}
 
-           (unsigned int)seq, (unsigned int)base);
+int flash_store_measurement(uint16_t seq)
+{
+    uint32_t base = rec_slot_addr(seq);
+    uint32_t crc;
 
     flash_write_buffer(base,
-                       (const uint8_t *)ppg1_buf,
+                       (const uint8_t *)ppg_buf[PPG_CH_RED],
                        TOTAL_BYTES_PER_VEC);
 
     flash_write_buffer(base + TOTAL_BYTES_PER_VEC,
-                       (const uint8_t *)ppg2_buf,
+                       (const uint8_t *)ppg_buf[PPG_CH_IR],
                        TOTAL_BYTES_PER_VEC);
 
     flash_write_buffer(base + TOTAL_BYTES_PER_VEC * 2u,
                        (const uint8_t *)&template_temp_val,
                        sizeof(template_temp_val));
 
-    return 0;
+    crc = crc32_ieee((const uint8_t *)ppg_buf[PPG_CH_RED], TOTAL_BYTES_PER_VEC);
+    crc = crc32_ieee_update(crc, (const uint8_t *)ppg_buf[PPG_CH_IR], TOTAL_BYTES_PER_VEC);
+    crc = crc32_ieee_update(crc, (const uint8_t *)&template_temp_val,
+                            sizeof(template_temp_val));
+
+    if (ECG_MODE_ENABLE) {
+        const uint16_t *rr;
+        const struct ptt_beat *beats;
+        uint16_t rr_buf[ECG_RR_MAX];
+        uint32_t n_rr = ecg_qrs_get_rr(&rr);
+
+        memset(rr_buf, 0xFF, sizeof(rr_buf));
+        memcpy(rr_buf, rr, n_rr * sizeof(uint16_t));
+
+        flash_write_buffer(base + SEQ_ECG_RR_OFF, (const uint8_t *)rr_buf, sizeof(rr_buf));
+        crc = crc32_ieee_update(crc, (const uint8_t *)rr_buf, sizeof(rr_buf));
+
+        (void)ptt_get_beats(&beats);
+
+        flash_write_buffer(base + SEQ_PTT_OFF, (const uint8_t *)beats, SEQ_PTT_BYTES);
+        crc = crc32_ieee_update(crc, (const uint8_t *)beats, SEQ_PTT_BYTES);
+
+        if (ECG_STORE_RAW) {
+            flash_write_buffer(base + SEQ_ECG_RAW_OFF, (const uint8_t *)ecg_buf, sizeof(ecg_buf));
+            crc = crc32_ieee_update(crc, (const uint8_t *)ecg_buf, sizeof(ecg_buf));
+        }
+    }
+
+    if (BIOZ_MODE_ENABLE) {
+        const float *z;
+        float z_buf[BIOZ_LEN];
+        uint32_t n_z = bioz_get(&z);
+
+        memset(z_buf, 0xFF, sizeof(z_buf));
+        memcpy(z_buf, z, n_z * sizeof(float));
+
+        flash_write_buffer(base + SEQ_BIOZ_OFF, (const uint8_t *)z_buf, sizeof(z_buf));
+        crc = crc32_ieee_update(crc, (const uint8_t *)z_buf, sizeof(z_buf));
+    }
+
+    for (uint32_t ch = 2; ch < PPG_NUM_SLOTS; ch++) {
+        uint32_t off = SEQ_PPG_EXT_OFF + (ch - 2u) * TOTAL_BYTES_PER_VEC;
+
+        flash_write_buffer(base + off, (const uint8_t *)ppg_buf[ch], TOTAL_BYTES_PER_VEC);
+        crc = crc32_ieee_update(crc, (const uint8_t *)ppg_buf[ch], TOTAL_BYTES_PER_VEC);
+    }
+
+    struct rec_hdr hdr;
+    memset(&hdr, 0xFF, sizeof(hdr));
+    /* wrap/step jumps fixed by ppg_fix_jump(); the host corrects records without it */
+    hdr.flags        = REC_FLAG_PPG_JUMPS;
+    hdr.length       = SEQ_TOTAL_BYTES;
+    hdr.timestamp_ms = template_ts_ms;
+    hdr.data_crc     = crc;
+    hdr.summary      = template_summary;
+    hdr.sbp_x10      = template_sbp_x10;
+    hdr.dbp_x10      = template_dbp_x10;
+    hdr.amb_red      = template_amb[0];
+    hdr.amb_ir       = template_amb[1];
+    hdr.noise_red    = template_noise[0];
+    hdr.noise_ir     = template_noise[1];
+    hdr.led_current[0] = ppg_agc_cache.valid ? ppg_agc_cache.led[0] : 0xFF;
+    hdr.led_current[1] = ppg_agc_cache.valid ? ppg_agc_cache.led[1] : 0xFF;
+    hdr.tia_gain[0]    = ppg_agc_cache.valid ? ppg_agc_cache.tia[0] : 0xFF;
+    hdr.tia_gain[1]    = ppg_agc_cache.valid ? ppg_agc_cache.tia[1] : 0xFF;
+    hdr.profile        = template_profile;
+    hdr.temp           = template_temp;
+    hdr.fifo           = template_fifo;
+    hdr.timebase       = template_timebase;
+    hdr.burst          = template_burst;
+    hdr.wake           = template_wake;
+    if (template_fifo.oflow) {
+        hdr.flags |= REC_FLAG_FIFO_GAP;
+    }
+
+    if (ECG_MODE_ENABLE) {
+        const uint16_t *rr;
+        const struct ptt_beat *beats;
+
+        hdr.flags       |= REC_FLAG_ECG | (ECG_STORE_RAW ? REC_FLAG_ECG_RAW : 0);
+        hdr.ecg_hr_x10   = ecg_qrs_hr_x10();
+        hdr.ecg_len      = (uint16_t)ecg_len;
+        hdr.ecg_rr_count = (uint8_t)ecg_qrs_get_rr(&rr);
+        hdr.ecg_status   = ecg_status;
+        hdr.pat_x10      = ptt_median_pat_x10();
+        hdr.pat_count    = (uint8_t)ptt_get_beats(&beats);
+    }
+
+    if (BIOZ_MODE_ENABLE) {
+        hdr.flags       |= REC_FLAG_BIOZ;
+        hdr.bioz_rr_x10  = template_bioz_rr_x10;
+    }
+
+    return rec_index_commit(seq, &hdr);
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "Funciones.h"
+
+#include <math.h>
+
+/*
+ * TMP117 skin temperature, sampled over the capture window without touching
+ * the capture thread. tmp117_start() and tmp117_stop() only queue work on the
+ * system workqueue, which switches the sensor between shutdown and
+ * continuous conversion (8x averaging, 1 s cycle) and collects each result
+ * when it is ready: on the ALERT pin in data-ready mode when the board
+ * defines a tmp117-alert alias and its interrupt can be set up, otherwise
+ * by polling the Data_Ready flag.
+ */
+#define I2C_NODE            DT_NODELABEL(i2c0)
+#define TMP117_ADDR         0x48
+#define TMP117_ALERT_NODE   DT_ALIAS(tmp117_alert)
+
+#define TMP117_REG_TEMP     0x00
+#define TMP117_REG_CONFIG   0x01
+#define TMP117_REG_ID       0x0F
+#define TMP117_DEVICE_ID    0x0117
+
+#define TMP117_CFG_DATA_READY   BIT(13)
+#define TMP117_CFG_MOD_CC       (0u << 10)
+#define TMP117_CFG_MOD_SD       (1u << 10)
+#define TMP117_CFG_CONV_1S      (4u << 7)
+#define TMP117_CFG_AVG_8        (1u << 5)
+#define TMP117_CFG_DR_ALERT     BIT(2)
+
+#define TMP117_CFG_RUN      (TMP117_CFG_MOD_CC | TMP117_CFG_CONV_1S | TMP117_CFG_AVG_8 | TMP117_CFG_DR_ALERT)
+#define TMP117_CFG_IDLE     (TMP117_CFG_MOD_SD | TMP117_CFG_AVG_8 | TMP117_CFG_DR_ALERT)
+#define TMP117_POLL_MS      250
+
+#define TMP117_LSB_C        0.0078125f
+#define TMP117_RAW_RESET    (-32768)
+#define TMP117_MIN_C        (-55.0f)
+#define TMP117_MAX_C        150.0f
+
+static const struct device *i2c_dev = DEVICE_DT_GET(I2C_NODE);
+
+#if DT_NODE_EXISTS(TMP117_ALERT_NODE)
+static const struct gpio_dt_spec tmp117_alert = GPIO_DT_SPEC_GET(TMP117_ALERT_NODE, gpios);
+static struct gpio_callback tmp117_alert_cb;
+#define TMP117_HAVE_ALERT   1
+#else
+#define TMP117_HAVE_ALERT   0
+#endif
+
+static struct k_spinlock tmp117_lock;
+static bool     tmp117_ok;
+static bool     tmp117_use_alert;
+static bool     tmp117_running;
+static int32_t  tmp117_sum;
+static uint8_t  tmp117_n;
+static uint8_t  tmp117_flags;
+
+static int tmp117_write_reg(uint8_t reg, uint16_t v)
+{
+    uint8_t buf[3] = { reg, (uint8_t)(v >> 8), (uint8_t)v };
+
+    return i2c_write(i2c_dev, buf, sizeof(buf), TMP117_ADDR);
+}
+
+static int tmp117_read_reg(uint8_t reg, uint16_t *v)
+{
+    uint8_t data[2];
+    int ret = i2c_write_read(i2c_dev, TMP117_ADDR, &reg, 1, data, 2);
+
+    if (ret < 0) {
+        return ret;
+    }
+    *v = sys_get_be16(data);
+    return 0;
+}
+
+static void tmp117_set_flag(uint8_t flag)
+{
+    k_spinlock_key_t key = k_spin_lock(&tmp117_lock);
+
+    tmp117_flags |= flag;
+    k_spin_unlock(&tmp117_lock, key);
+}
+
+static void tmp117_read_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(tmp117_read_work, tmp117_read_handler);
+
+/* reading the config register clears Data_Ready and releases ALERT */
+static void tmp117_read_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    uint16_t cfg, raw;
+
+    if (tmp117_read_reg(TMP117_REG_CONFIG, &cfg) < 0) {
+        tmp117_set_flag(TEMP_FLAG_I2C_ERR);
+    } else if ((cfg & TMP117_CFG_DATA_READY) && tmp117_read_reg(TMP117_REG_TEMP, &raw) < 0) {
+        tmp117_set_flag(TEMP_FLAG_I2C_ERR);
+    } else if (cfg & TMP117_CFG_DATA_READY) {
+        int16_t t = (int16_t)raw;
+        float c = t * TMP117_LSB_C;
+        k_spinlock_key_t key = k_spin_lock(&tmp117_lock);
+
+        if (tmp117_running) {
+            if (t == TMP117_RAW_RESET || c < TMP117_MIN_C || c > TMP117_MAX_C) {
+                tmp117_flags |= TEMP_FLAG_RANGE;
+            } else if (tmp117_n < UINT8_MAX) {
+                tmp117_sum += t;
+                tmp117_n++;
+            }
+        }
+        k_spin_unlock(&tmp117_lock, key);
+    }
+
+    if (!tmp117_use_alert && tmp117_running) {
+        k_work_reschedule(&tmp117_read_work, K_MSEC(TMP117_POLL_MS));
+    }
+}
+
+static void tmp117_start_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (tmp117_write_reg(TMP117_REG_CONFIG, TMP117_CFG_RUN) < 0) {
+        tmp117_set_flag(TEMP_FLAG_I2C_ERR);
+        return;
+    }
+    if (!tmp117_use_alert) {
+        k_work_reschedule(&tmp117_read_work, K_MSEC(TMP117_POLL_MS));
+    }
+}
+K_WORK_DEFINE(tmp117_start_work, tmp117_start_handler);
+
+static void tmp117_stop_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    (void)k_work_cancel_delayable(&tmp117_read_work);
+    (void)tmp117_write_reg(TMP117_REG_CONFIG, TMP117_CFG_IDLE);
+}
+K_WORK_DEFINE(tmp117_stop_work, tmp117_stop_handler);
+
+#if TMP117_HAVE_ALERT
+static void tmp117_alert_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+    ARG_UNUSED(port); ARG_UNUSED(cb); ARG_UNUSED(pins);
+
+    k_work_reschedule(&tmp117_read_work, K_NO_WAIT);
+}
+#endif
+
+void init_i2c(void)
+{
+    uint16_t id = 0;
+
+    if (!device_is_ready(i2c_dev)) {
+        printk("I2C0 NOT READY\n");
+        return;
+    }
+    printk("I2C0 OK\n");
+
+    if (tmp117_read_reg(TMP117_REG_ID, &id) < 0 || id != TMP117_DEVICE_ID ||
+        tmp117_write_reg(TMP117_REG_CONFIG, TMP117_CFG_IDLE) < 0) {
+        printk("TMP117 not found (id 0x%04x)\n", id);
+        return;
+    }
+
+#if TMP117_HAVE_ALERT
+    if (gpio_is_ready_dt(&tmp117_alert) &&
+        gpio_pin_configure_dt(&tmp117_alert, GPIO_INPUT) == 0 &&
+        gpio_pin_interrupt_configure_dt(&tmp117_alert, GPIO_INT_EDGE_TO_ACTIVE) == 0) {
+        gpio_init_callback(&tmp117_alert_cb, tmp117_alert_isr, BIT(tmp117_alert.pin));
+        tmp117_use_alert = gpio_add_callback(tmp117_alert.port, &tmp117_alert_cb) == 0;
+    }
+    if (!tmp117_use_alert) {
+        if (gpio_is_ready_dt(&tmp117_alert)) {
+            (void)gpio_pin_interrupt_configure_dt(&tmp117_alert, GPIO_INT_DISABLE);
+        }
+        printk("TMP117 ALERT unavailable, polling\n");
+    }
+#endif
+    tmp117_ok = true;
+}
+
+void tmp117_start(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&tmp117_lock);
+
+    tmp117_sum     = 0;
+    tmp117_n       = 0;
+    tmp117_flags   = tmp117_ok ? 0 : TEMP_FLAG_I2C_ERR;
+    tmp117_running = tmp117_ok;
+    k_spin_unlock(&tmp117_lock, key);
+
+    if (tmp117_ok) {
+        k_work_submit(&tmp117_start_work);
+    }
+}
+
+/* r may be NULL when the capture is abandoned */
+void tmp117_stop(struct temp_result *r)
+{
+    k_spinlock_key_t key = k_spin_lock(&tmp117_lock);
+    bool was_running = tmp117_running;
+
+    tmp117_running = false;
+    if (r) {
+        r->count     = tmp117_n;
+        r->flags     = tmp117_flags | (tmp117_n ? TEMP_FLAG_VALID : 0);
+        r->mean_x100 = tmp117_n ? (int16_t)lroundf((float)tmp117_sum * TMP117_LSB_C * 100.0f / tmp117_n)
+                                : INT16_MIN;
+    }
+    k_spin_unlock(&tmp117_lock, key);
+
+    if (was_running) {
+        k_work_submit(&tmp117_stop_work);
+    }
+}
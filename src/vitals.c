@@ -0,0 +1,512 @@
+#include "Funciones.h"
+
+#include <math.h>
+
+#define HR_FS_HZ        ((float)PPG_FS_HZ / (float)PPG_FILT_DECIM_BPM)
+#define HR_IBI_MIN      ((60.0f / 220.0f) * HR_FS_HZ)
+#define HR_IBI_MAX      ((60.0f / 40.0f) * HR_FS_HZ)
+#define HR_MAX_IBI      48u
+#define HR_LEARN_S      1.5f
+#define HR_REFRACT_S    0.35f
+
+#define SPO2_FS_HZ      ((float)PPG_FS_HZ / (float)PPG_FILT_DECIM_SPO2)
+#define SPO2_REFRACT_S  0.32f
+#define SPO2_A          110.0f
+#define SPO2_B          25.0f
+
+/*
+ * RR: the IR baseline is boxcar-averaged 25:1 (125 Hz -> 5 Hz) as samples
+ * arrive, giving 40 points per window (160 bytes). At the end a Goertzel
+ * bank scans 0.10-0.50 Hz in 0.01 Hz steps: 41 bins x 40 samples, about
+ * 1.7k multiply-adds plus 41 cosf(), well under 1 ms on the M4F.
+ */
+#define RR_DECIM        25u
+#define RR_FS_HZ        ((float)PPG_FS_HZ / (float)RR_DECIM)
+#define RR_LEN          (VEC_LEN / RR_DECIM)
+#define RR_F_MIN        0.10f
+#define RR_F_MAX        0.50f
+#define RR_F_STEP       0.01f
+
+#define SQI_TPL_MAX     12
+#define SQI_PI_LO       0.02f
+#define SQI_PI_HI       0.20f
+#define SQI_CLIP_MARGIN 0.98f
+#define SQI_FLAT_RUN    4u
+
+struct hr_chan {
+    float    mean;
+    float    y1, y2;
+    float    trough;
+    float    peak_avg;
+    float    prom_avg;
+    float    last_t;
+    float    last_val;
+    float    prev_t;
+    float    sum_sq;
+    float    prom_sum;
+    float    refract;
+    uint32_t learn_n;
+    uint32_t n;
+    uint16_t n_peaks;
+    uint16_t n_ibi;
+    uint16_t n_pk;
+    float    ibi[HR_MAX_IBI];
+    float    pk[HR_MAX_IBI + 1u];
+};
+
+struct spo2_acc {
+    float    red_mean;
+    float    ir_mean;
+    float    red_sq;
+    float    ir_sq;
+    float    red_dc;
+    float    ir_dc;
+    uint32_t n;
+    bool     started;
+    float    spo2_sum;
+    uint16_t n_beats;
+};
+
+static struct hr_chan hr_ch[2];
+static struct hr_chan spo2_det;
+static struct spo2_acc spo2;
+static float    rr_buf[RR_LEN];
+static int64_t  rr_acc;
+static uint32_t rr_pos;
+static uint32_t raw_full_scale[2];
+static int64_t  raw_sum[2];
+static int32_t  raw_prev[2];
+static uint32_t raw_run[2];
+static uint32_t raw_clip[2];
+static uint32_t vitals_bpm_pos;
+static uint32_t vitals_spo2_pos;
+
+static void hr_chan_reset(struct hr_chan *c, float fs, float refract_s)
+{
+    memset(c, 0, sizeof(*c));
+    c->last_t  = -1.0f;
+    c->prev_t  = -1.0f;
+    c->refract = refract_s * fs;
+    c->learn_n = (uint32_t)(HR_LEARN_S * fs);
+}
+
+static bool hr_accept_peak(struct hr_chan *c, float t, float val)
+{
+    float prom = val - c->trough;
+
+    if (c->last_t >= 0.0f && (t - c->last_t) < c->refract) {
+        if (val <= c->last_val) {
+            return false;
+        }
+        if (c->prev_t >= 0.0f && c->n_ibi) {
+            c->ibi[c->n_ibi - 1u] = t - c->prev_t;
+        }
+        if (c->n_pk) {
+            c->pk[c->n_pk - 1u] = t;
+        }
+        c->last_t   = t;
+        c->last_val = val;
+        return false;
+    }
+
+    if (c->last_t >= 0.0f && c->n_ibi < HR_MAX_IBI) {
+        c->ibi[c->n_ibi++] = t - c->last_t;
+    }
+
+    if (c->n_pk < ARRAY_SIZE(c->pk)) {
+        c->pk[c->n_pk++] = t;
+    }
+
+    c->prom_sum += prom;
+    c->n_peaks++;
+    c->prev_t   = c->last_t;
+    c->last_t   = t;
+    c->last_val = val;
+    c->trough   = val;
+    c->peak_avg += (val - c->peak_avg) * 0.125f;
+    c->prom_avg += (prom - c->prom_avg) * 0.125f;
+    return true;
+}
+
+static bool hr_chan_push(struct hr_chan *c, int32_t x)
+{
+    bool beat = false;
+    float y;
+
+    if (c->n == 0) {
+        c->mean = (float)x;
+    }
+    c->mean += ((float)x - c->mean) * (1.0f / 64.0f);
+    y = (float)x - c->mean;
+    c->sum_sq += y * y;
+
+    if (c->n < c->learn_n) {
+        c->peak_avg = MAX(c->peak_avg, y);
+        c->prom_avg = c->peak_avg - MIN(c->trough, y);
+    } else {
+        c->peak_avg -= c->peak_avg * (1.0f / 512.0f);
+        c->prom_avg -= c->prom_avg * (1.0f / 512.0f);
+
+        if (c->y1 > c->y2 && c->y1 >= y &&
+            c->y1 > 0.5f * c->peak_avg &&
+            (c->y1 - c->trough) > 0.5f * c->prom_avg) {
+            float d   = c->y2 - 2.0f * c->y1 + y;
+            float off = (d < 0.0f) ? 0.5f * (c->y2 - y) / d : 0.0f;
+
+            beat = hr_accept_peak(c, (float)(c->n - 1u) + off, c->y1);
+        }
+    }
+
+    if (y < c->trough) {
+        c->trough = y;
+    }
+    c->y2 = c->y1;
+    c->y1 = y;
+    c->n++;
+    return beat;
+}
+
+static float hr_chan_quality(const struct hr_chan *c)
+{
+    if (c->n_peaks == 0 || c->n == 0 || c->sum_sq <= 0.0f) {
+        return 0.0f;
+    }
+    return (c->prom_sum / c->n_peaks) / sqrtf(c->sum_sq / c->n);
+}
+
+static float hr_chan_median_ibi(const struct hr_chan *c)
+{
+    float v[HR_MAX_IBI];
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < c->n_ibi; i++) {
+        float x = c->ibi[i];
+        if (x <= HR_IBI_MIN || x >= HR_IBI_MAX) {
+            continue;
+        }
+        uint32_t j = n++;
+        while (j > 0 && v[j - 1u] > x) {
+            v[j] = v[j - 1u];
+            j--;
+        }
+        v[j] = x;
+    }
+
+    if (n == 0) {
+        return 0.0f;
+    }
+    return (n & 1u) ? v[n / 2u] : 0.5f * (v[n / 2u - 1u] + v[n / 2u]);
+}
+
+static void spo2_close_beat(struct spo2_acc *a)
+{
+    if (a->started && a->n && a->red_sq > 0.0f && a->ir_sq > 0.0f &&
+        a->red_dc > 0.0f && a->ir_dc > 0.0f) {
+        float red = sqrtf(a->red_sq / a->n) / (a->red_dc / a->n);
+        float ir  = sqrtf(a->ir_sq / a->n) / (a->ir_dc / a->n);
+        float v   = SPO2_A - SPO2_B * (red / ir);
+
+        a->spo2_sum += CLAMP(v, 70.0f, 100.0f);
+        a->n_beats++;
+    }
+
+    a->started = true;
+    a->red_sq = 0.0f;
+    a->ir_sq  = 0.0f;
+    a->red_dc = 0.0f;
+    a->ir_dc  = 0.0f;
+    a->n      = 0;
+}
+
+static void spo2_push(int32_t red_f, int32_t ir_f, int32_t red_raw, int32_t ir_raw)
+{
+    struct spo2_acc *a = &spo2;
+
+    if (vitals_spo2_pos == 0) {
+        a->red_mean = (float)red_f;
+        a->ir_mean  = (float)ir_f;
+    }
+    a->red_mean += ((float)red_f - a->red_mean) * (1.0f / 64.0f);
+    a->ir_mean  += ((float)ir_f - a->ir_mean) * (1.0f / 64.0f);
+
+    if (hr_chan_push(&spo2_det, ir_f)) {
+        spo2_close_beat(a);
+    }
+
+    float red_ac = (float)red_f - a->red_mean;
+    float ir_ac  = (float)ir_f - a->ir_mean;
+
+    a->red_sq += red_ac * red_ac;
+    a->ir_sq  += ir_ac * ir_ac;
+    a->red_dc += (float)red_raw;
+    a->ir_dc  += (float)ir_raw;
+    a->n++;
+}
+
+static void raw_push(int ch, int32_t x)
+{
+    raw_sum[ch] += x;
+
+    if (rr_pos > 0 && x == raw_prev[ch]) {
+        raw_run[ch]++;
+    } else {
+        raw_run[ch] = 0;
+    }
+    raw_prev[ch] = x;
+
+    if (x <= 0 || (raw_full_scale[ch] && (uint32_t)x >= (uint32_t)(SQI_CLIP_MARGIN * raw_full_scale[ch])) ||
+        raw_run[ch] >= SQI_FLAT_RUN) {
+        raw_clip[ch]++;
+    }
+}
+
+static void rr_push(int32_t x)
+{
+    rr_acc += x;
+    rr_pos++;
+    if (rr_pos % RR_DECIM == 0 && rr_pos / RR_DECIM <= RR_LEN) {
+        rr_buf[rr_pos / RR_DECIM - 1u] = (float)rr_acc / (float)RR_DECIM;
+        rr_acc = 0;
+    }
+}
+
+static float rr_goertzel(const float *x, uint32_t n, float f, float fs)
+{
+    float w  = 2.0f * 3.14159265f * f / fs;
+    float c  = 2.0f * cosf(w);
+    float s1 = 0.0f, s2 = 0.0f;
+
+    for (uint32_t i = 0; i < n; i++) {
+        float s0 = x[i] + c * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+    return s1 * s1 + s2 * s2 - c * s1 * s2;
+}
+
+static float sqi_template_corr(const struct hr_chan *c, const int32_t *y, uint32_t len,
+                               int half)
+{
+    float tpl[2 * SQI_TPL_MAX + 1];
+    uint32_t n_seg = 0;
+    const int w = 2 * half + 1;
+
+    memset(tpl, 0, sizeof(tpl));
+    for (uint32_t p = 0; p < c->n_pk; p++) {
+        int k0 = (int)(c->pk[p] + 0.5f) - half;
+        if (k0 < 0 || k0 + w > (int)len) {
+            continue;
+        }
+        for (int j = 0; j < w; j++) {
+            tpl[j] += (float)y[k0 + j];
+        }
+        n_seg++;
+    }
+    if (n_seg < 2u) {
+        return 0.0f;
+    }
+
+    float tm = 0.0f;
+    for (int j = 0; j < w; j++) {
+        tpl[j] /= n_seg;
+        tm += tpl[j];
+    }
+    tm /= w;
+
+    float r_sum = 0.0f;
+    for (uint32_t p = 0; p < c->n_pk; p++) {
+        int k0 = (int)(c->pk[p] + 0.5f) - half;
+        if (k0 < 0 || k0 + w > (int)len) {
+            continue;
+        }
+
+        float sm = 0.0f;
+        for (int j = 0; j < w; j++) {
+            sm += (float)y[k0 + j];
+        }
+        sm /= w;
+
+        float sxy = 0.0f, sxx = 0.0f, syy = 0.0f;
+        for (int j = 0; j < w; j++) {
+            float a = tpl[j] - tm;
+            float b = (float)y[k0 + j] - sm;
+            sxy += a * b;
+            sxx += a * a;
+            syy += b * b;
+        }
+        if (sxx > 0.0f && syy > 0.0f) {
+            r_sum += sxy / sqrtf(sxx * syy);
+        }
+    }
+    return r_sum / n_seg;
+}
+
+static float sqi_ramp(float x, float lo, float hi)
+{
+    return CLAMP((x - lo) / (hi - lo), 0.0f, 1.0f);
+}
+
+static uint8_t sqi_compute(int ch, const struct hr_chan *c)
+{
+    const int32_t *red, *ir;
+    uint32_t len = ppg_filter_get(PPG_FILT_BPM, &red, &ir);
+    uint32_t n_rr = MIN(rr_pos / RR_DECIM, RR_LEN);
+
+    if (rr_pos == 0 || c->n == 0 || c->n_pk < 2u) {
+        return 0;
+    }
+
+    float dc     = (float)raw_sum[ch] / (float)rr_pos;
+    float ac_rms = sqrtf(c->sum_sq / c->n);
+    float pi     = (dc > 0.0f) ? 100.0f * ac_rms / dc : 0.0f;
+
+    float ibi  = hr_chan_median_ibi(c);
+    float mad  = 0.0f;
+    uint32_t n_ibi = 0;
+    for (uint32_t i = 0; i < c->n_ibi; i++) {
+        if (c->ibi[i] > HR_IBI_MIN && c->ibi[i] < HR_IBI_MAX) {
+            mad += fabsf(c->ibi[i] - ibi);
+            n_ibi++;
+        }
+    }
+    if (ibi <= 0.0f || n_ibi < 2u) {
+        return 0;
+    }
+    float reg = 1.0f - sqi_ramp(mad / n_ibi / ibi, 0.05f, 0.25f);
+
+    int half = CLAMP((int)(0.4f * ibi), 2, SQI_TPL_MAX);
+    float corr = sqi_template_corr(c, ch ? ir : red, len, half);
+
+    float clip = (float)raw_clip[ch] / (float)rr_pos;
+
+    float lo = rr_buf[0], hi = rr_buf[0];
+    for (uint32_t i = 1; i < n_rr; i++) {
+        lo = MIN(lo, rr_buf[i]);
+        hi = MAX(hi, rr_buf[i]);
+    }
+    float wander = (ac_rms > 0.0f) ? (hi - lo) / (2.83f * ac_rms) : 100.0f;
+
+    float score = 0.5f * reg + 0.5f * sqi_ramp(corr, 0.7f, 0.95f);
+    score *= 0.6f + 0.2f * sqi_ramp(pi, SQI_PI_LO, SQI_PI_HI) +
+             0.2f * (1.0f - sqi_ramp(wander, 2.0f, 10.0f));
+    score *= 1.0f - sqi_ramp(clip, 0.0f, 0.05f);
+
+    return (uint8_t)(100.0f * score + 0.5f);
+}
+
+/* detrends and windows x in place */
+uint16_t vitals_rr_estimate(float *x, uint32_t n, float fs)
+{
+    float xm = 0.5f * (float)(n - 1u);
+    float sy = 0.0f, sxy = 0.0f, sxx = 0.0f;
+
+    if (n < 8u) {
+        return REC_SUM_NA;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        sy += x[i];
+    }
+    float ym = sy / n;
+    for (uint32_t i = 0; i < n; i++) {
+        float dx = (float)i - xm;
+        sxy += dx * (x[i] - ym);
+        sxx += dx * dx;
+    }
+    float slope = sxy / sxx;
+
+    for (uint32_t i = 0; i < n; i++) {
+        float win = 0.5f - 0.5f * cosf(2.0f * 3.14159265f * i / (n - 1u));
+        x[i] = (x[i] - ym - slope * ((float)i - xm)) * win;
+    }
+
+    float best_p = 0.0f, best_f = 0.0f;
+    for (float f = RR_F_MIN; f <= RR_F_MAX + 0.5f * RR_F_STEP; f += RR_F_STEP) {
+        float pw = rr_goertzel(x, n, f, fs);
+        if (pw > best_p) {
+            best_p = pw;
+            best_f = f;
+        }
+    }
+
+    float rr = best_f * 60.0f;
+    if (best_p <= 0.0f || rr < 6.0f || rr > 35.0f) {
+        return REC_SUM_NA;
+    }
+    return (uint16_t)(rr * 10.0f + 0.5f);
+}
+
+/* full_scale[]: red, IR ADC full scale in counts (0 = no clip check) */
+void vitals_reset(const uint32_t full_scale[2])
+{
+    hr_chan_reset(&hr_ch[0], HR_FS_HZ, HR_REFRACT_S);
+    hr_chan_reset(&hr_ch[1], HR_FS_HZ, HR_REFRACT_S);
+    hr_chan_reset(&spo2_det, SPO2_FS_HZ, SPO2_REFRACT_S);
+    memset(&spo2, 0, sizeof(spo2));
+    rr_acc = 0;
+    rr_pos = 0;
+    raw_full_scale[0] = full_scale[0];
+    raw_full_scale[1] = full_scale[1];
+    memset(raw_sum, 0, sizeof(raw_sum));
+    memset(raw_prev, 0, sizeof(raw_prev));
+    memset(raw_run, 0, sizeof(raw_run));
+    memset(raw_clip, 0, sizeof(raw_clip));
+    vitals_bpm_pos  = 0;
+    vitals_spo2_pos = 0;
+}
+
+void vitals_update(const int32_t *red_raw, const int32_t *ir_raw)
+{
+    const int32_t *red, *ir;
+    uint32_t n = ppg_filter_get(PPG_FILT_BPM, &red, &ir);
+    uint32_t delay = ppg_filter_group_delay(PPG_FILT_SPO2);
+
+    for (; vitals_bpm_pos < n; vitals_bpm_pos++) {
+        hr_chan_push(&hr_ch[0], red[vitals_bpm_pos]);
+        hr_chan_push(&hr_ch[1], ir[vitals_bpm_pos]);
+    }
+
+    while (rr_pos < n * PPG_FILT_DECIM_BPM) {
+        raw_push(0, red_raw[rr_pos]);
+        raw_push(1, ir_raw[rr_pos]);
+        rr_push(ir_raw[rr_pos]);
+    }
+
+    n = ppg_filter_get(PPG_FILT_SPO2, &red, &ir);
+    for (; vitals_spo2_pos < n; vitals_spo2_pos++) {
+        uint32_t k = (vitals_spo2_pos + 1u) * PPG_FILT_DECIM_SPO2 - 1u;
+
+        k = (k > delay) ? k - delay : 0u;
+        spo2_push(red[vitals_spo2_pos], ir[vitals_spo2_pos], red_raw[k], ir_raw[k]);
+    }
+}
+
+void vitals_finish(struct rec_summary *s)
+{
+    memset(s, 0xFF, sizeof(*s));
+    s->flags = 0;
+
+    float q_red = hr_chan_quality(&hr_ch[0]);
+    float q_ir  = hr_chan_quality(&hr_ch[1]);
+    const struct hr_chan *c = (q_ir > q_red) ? &hr_ch[1] : &hr_ch[0];
+    int ch = (c == &hr_ch[1]) ? 1 : 0;
+
+    if (ch) {
+        s->flags |= REC_SUM_HR_IR;
+    }
+    s->quality = sqi_compute(ch, c);
+    if (s->quality < SQI_MIN) {
+        s->flags |= REC_SUM_LOW_SQI;
+    }
+
+    float ibi = hr_chan_median_ibi(c);
+    if (ibi > 0.0f) {
+        s->hr_x10 = (uint16_t)(600.0f * HR_FS_HZ / ibi + 0.5f);
+    }
+
+    s->rr_x10 = vitals_rr_estimate(rr_buf, MIN(rr_pos / RR_DECIM, RR_LEN), RR_FS_HZ);
+
+    if (spo2.n_beats) {
+        s->spo2_x10 = (uint16_t)(10.0f * spo2.spo2_sum / spo2.n_beats + 0.5f);
+    }
+}